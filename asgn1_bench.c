@@ -0,0 +1,665 @@
+/**
+ * File: asgn1_bench.c
+ *
+ * Benchmarks the asgn1 ramdisk: sequential and random read and write
+ * throughput and latency percentiles across block and device sizes, mmap
+ * fault and scan speed and the cost of open() on a large device. Runs can
+ * be spread over several processes and the results are written as JSON so
+ * they can be compared from run to run.
+ *
+ * With -C a cache-sensitive workload, chasing pointers through a working set
+ * of the given size, is also timed alone and alongside processes streaming
+ * through the device with and without nocache, to show how much of its cache
+ * the streaming takes away. The cost per cache line of flushing what a
+ * nocache read leaves behind is measured too.
+ *
+ * Each device size is set up by opening the device write-only, which
+ * empties it, and writing it full. Load the module in ramdisk mode.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "bench_common.h"
+
+#define MYIOC_TYPE 'k'
+#define SET_NPROC_OP 1
+#define SET_NOCACHE_OP 6
+#define TEM_SET_NPROC _IOW(MYIOC_TYPE, SET_NPROC_OP, int)
+#define TEM_SET_NOCACHE _IOW(MYIOC_TYPE, SET_NOCACHE_OP, int)
+
+#define OPEN_ITERATIONS 10000
+#define CACHE_LINE 64
+#define STREAM_BLOCK (1 << 20)          /* large enough to stream uncached */
+#define STREAM_BYTES (256UL << 20)      /* read for the flush cost */
+#define CHASE_STEPS (1 << 20)           /* loads per round of the chase */
+#define CHASE_ROUNDS 31
+
+enum test_kind { SEQ_WRITE, SEQ_READ, RAND_WRITE, RAND_READ };
+static const char *test_names[] = {
+    "seq_write", "seq_read", "rand_write", "rand_read"
+};
+
+/* options */
+static char *filename = "/dev/asgn1";
+static unsigned long device_sizes[MAX_SIZES];
+static int nr_device_sizes;
+static unsigned long block_sizes[MAX_SIZES];
+static int nr_block_sizes;
+static int nproc = 1;
+static int nocache;
+static unsigned long max_ops = 1 << 18;   /* per process per test */
+static unsigned long cache_size;          /* chase working set, 0 for none */
+static FILE *out;
+
+/* latencies of every process in the current test, in shared memory */
+static uint64_t *lat;
+static unsigned long lat_slots;         /* latencies kept per process */
+static uint64_t *elapsed;               /* wall time of each process */
+static uint64_t *streamed;              /* bytes each streamer moved */
+static volatile int *stream_stop;
+static int first_result = 1;
+static void * volatile chase_sink;
+
+static int cmp_u64 (const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static uint64_t percentile (uint64_t *sorted, unsigned long n, double p)
+{
+    unsigned long i = (unsigned long)(p * (n - 1) + 0.5);
+
+    return n ? sorted[i] : 0;
+}
+
+/**
+ * Writes one result object. Latencies are sorted in place.
+ */
+static void report (const char *test, unsigned long device_size,
+                    unsigned long block_size, unsigned long bytes,
+                    uint64_t ns, uint64_t *lats, unsigned long nr_lats)
+{
+    double seconds = ns / 1e9;
+
+    qsort (lats, nr_lats, sizeof(uint64_t), cmp_u64);
+    fprintf (out, "%s\n    {\"test\": \"%s\", \"device_size\": %lu, "
+             "\"block_size\": %lu, \"nproc\": %d, \"nocache\": %d, "
+             "\"bytes\": %lu, \"ops\": %lu, \"seconds\": %.6f, "
+             "\"mb_per_s\": %.2f, \"lat_ns\": {\"p50\": %llu, "
+             "\"p90\": %llu, \"p99\": %llu, \"p999\": %llu, "
+             "\"max\": %llu}}",
+             first_result ? "" : ",", test, device_size, block_size, nproc,
+             nocache, bytes, nr_lats, seconds,
+             seconds > 0 ? bytes / seconds / (1 << 20) : 0.0,
+             (unsigned long long)percentile (lats, nr_lats, 0.5),
+             (unsigned long long)percentile (lats, nr_lats, 0.9),
+             (unsigned long long)percentile (lats, nr_lats, 0.99),
+             (unsigned long long)percentile (lats, nr_lats, 0.999),
+             (unsigned long long)(nr_lats ? lats[nr_lats - 1] : 0));
+    first_result = 0;
+    fflush (out);
+}
+
+static int open_device (int flags)
+{
+    int fd;
+
+    if ((fd = open (filename, flags)) < 0)
+        die ("open");
+    if (nocache && ioctl (fd, TEM_SET_NOCACHE, &nocache) < 0)
+        die ("TEM_SET_NOCACHE");
+    return fd;
+}
+
+/**
+ * Empties the device and writes it full so every test has size bytes of
+ * data to work on.
+ */
+static void fill_device (unsigned long size)
+{
+    static char buf[1 << 20];
+    unsigned long done;
+    ssize_t written;
+    int fd = open_device (O_WRONLY);
+
+    memset (buf, 0x5a, sizeof(buf));
+    for (done = 0; done < size; done += written) {
+        unsigned long len = size - done < sizeof(buf) ? size - done
+                                                      : sizeof(buf);
+
+        if ((written = write (fd, buf, len)) <= 0)
+            die ("write");
+    }
+    close (fd);
+}
+
+/**
+ * One process's share of a read or write test. Sequential tests work
+ * through the process's own slice of the device, random tests pick block
+ * aligned offsets over the whole device.
+ */
+static void run_worker (int id, enum test_kind kind, unsigned long size,
+                        unsigned long bs, unsigned long ops, char *buf)
+{
+    unsigned long slice = size / nproc / bs * bs;
+    unsigned long blocks = size / bs;
+    uint64_t *my_lat = lat + id * lat_slots;
+    uint64_t start, t;
+    unsigned long i;
+    off_t pos;
+    ssize_t result;
+    int fd = open_device (O_RDWR);
+
+    srandom (getpid ());
+    start = now_ns ();
+    for (i = 0; i < ops; i++) {
+        if (kind == SEQ_WRITE || kind == SEQ_READ)
+            pos = (off_t)id * slice + (i * bs) % slice;
+        else
+            pos = (off_t)(random () % blocks) * bs;
+
+        t = now_ns ();
+        if (kind == SEQ_WRITE || kind == RAND_WRITE)
+            result = pwrite (fd, buf, bs, pos);
+        else
+            result = pread (fd, buf, bs, pos);
+        my_lat[i] = now_ns () - t;
+
+        if (result != (ssize_t)bs) {
+            fprintf (stderr, "%s of %lu bytes at %lld returned %zd\n",
+                     test_names[kind], bs, (long long)pos, result);
+            exit (1);
+        }
+    }
+    elapsed[id] = now_ns () - start;
+    close (fd);
+}
+
+/**
+ * Starts fn in nproc processes at once.
+ */
+static void start_procs (void (*fn) (int, void *), void *arg)
+{
+    int i;
+    pid_t pid;
+
+    // children must not write out what is buffered for the results
+    fflush (out);
+    for (i = 0; i < nproc; i++) {
+        if ((pid = fork ()) < 0)
+            die ("fork");
+        if (pid == 0) {
+            fn (i, arg);
+            _exit (0);
+        }
+    }
+}
+
+/**
+ * Waits for the processes start_procs started, exiting if any failed.
+ */
+static void wait_procs (void)
+{
+    int i, status, failed = 0;
+
+    for (i = 0; i < nproc; i++) {
+        if (wait (&status) < 0 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0)
+            failed = 1;
+    }
+    if (failed) {
+        fprintf (stderr, "a benchmark process failed\n");
+        exit (1);
+    }
+}
+
+/**
+ * Runs fn in nproc processes at once and waits for them all.
+ */
+static void run_procs (void (*fn) (int, void *), void *arg)
+{
+    start_procs (fn, arg);
+    wait_procs ();
+}
+
+/**
+ * Moves the first n latencies of each process together so they can be
+ * reported as one set.
+ */
+static void gather (unsigned long n)
+{
+    int i;
+
+    for (i = 1; i < nproc; i++)
+        memmove (lat + i * n, lat + i * lat_slots, n * sizeof(uint64_t));
+}
+
+static uint64_t slowest (void)
+{
+    uint64_t ns = 0;
+    int i;
+
+    for (i = 0; i < nproc; i++)
+        ns = elapsed[i] > ns ? elapsed[i] : ns;
+    return ns;
+}
+
+struct rw_args {
+    enum test_kind kind;
+    unsigned long size, bs, ops;
+};
+
+static void rw_proc (int id, void *arg)
+{
+    struct rw_args *a = arg;
+    char *buf;
+
+    if (posix_memalign ((void **)&buf, 4096, a->bs) != 0)
+        die ("posix_memalign");
+    memset (buf, id, a->bs);
+    run_worker (id, a->kind, a->size, a->bs, a->ops, buf);
+}
+
+static void bench_rw (unsigned long size, unsigned long bs)
+{
+    struct rw_args a;
+    unsigned long ops = size / nproc / bs;
+
+    if (ops == 0)
+        return;
+    if (ops > max_ops)
+        ops = max_ops;
+
+    a.size = size;
+    a.bs = bs;
+    a.ops = ops;
+    for (a.kind = SEQ_WRITE; a.kind <= RAND_READ; a.kind++) {
+        run_procs (rw_proc, &a);
+        gather (ops);
+        report (test_names[a.kind], size, bs, ops * bs * nproc, slowest (),
+                lat, ops * nproc);
+    }
+}
+
+struct mmap_args {
+    unsigned long size;
+    int advice;
+};
+
+/**
+ * Maps the whole device, touches one byte per page to measure faults and
+ * then reads all of it to measure scanning mapped pages.
+ */
+static void mmap_proc (int id, void *arg)
+{
+    struct mmap_args *a = arg;
+    long page_size = sysconf (_SC_PAGESIZE);
+    unsigned long pages = a->size / page_size;
+    uint64_t *my_lat = lat + id * lat_slots;
+    volatile char *map;
+    uint64_t start, sum = 0;
+    unsigned long i;
+    int fd = open_device (O_RDWR);
+
+    map = mmap (NULL, a->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+        die ("mmap");
+    if (madvise ((void *)map, a->size, a->advice) < 0)
+        die ("madvise");
+
+    start = now_ns ();
+    for (i = 0; i < pages; i++)
+        sum += map[i * page_size];
+    my_lat[0] = now_ns () - start;
+
+    start = now_ns ();
+    for (i = 0; i < a->size / sizeof(uint64_t); i++)
+        sum += ((volatile uint64_t *)map)[i];
+    my_lat[1] = now_ns () - start;
+
+    (void)sum;
+    munmap ((void *)map, a->size);
+    close (fd);
+}
+
+static void bench_mmap (unsigned long size)
+{
+    static const int advice[] = { MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM };
+    static const char *names[][2] = {
+        { "mmap_fault", "mmap_scan" },
+        { "mmap_fault_seq", "mmap_scan_seq" },
+        { "mmap_fault_random", "mmap_scan_random" },
+    };
+    uint64_t fault_lat[nproc], scan_lat[nproc];
+    uint64_t fault_ns, scan_ns;
+    struct mmap_args a;
+    unsigned int i;
+    int p;
+
+    a.size = size;
+    for (i = 0; i < sizeof(advice) / sizeof(advice[0]); i++) {
+        a.advice = advice[i];
+        run_procs (mmap_proc, &a);
+        fault_ns = scan_ns = 0;
+
+        // each process left its fault and scan times in its latency slots
+        for (p = 0; p < nproc; p++) {
+            uint64_t *my_lat = lat + p * lat_slots;
+
+            fault_lat[p] = my_lat[0];
+            scan_lat[p] = my_lat[1];
+            fault_ns = fault_lat[p] > fault_ns ? fault_lat[p] : fault_ns;
+            scan_ns = scan_lat[p] > scan_ns ? scan_lat[p] : scan_ns;
+        }
+        report (names[i][0], size, sysconf (_SC_PAGESIZE), size * nproc,
+                fault_ns, fault_lat, nproc);
+        report (names[i][1], size, sizeof(uint64_t), size * nproc,
+                scan_ns, scan_lat, nproc);
+    }
+}
+
+static void open_proc (int id, void *arg)
+{
+    uint64_t *my_lat = lat + id * lat_slots;
+    uint64_t start = now_ns (), t;
+    int i, fd;
+
+    (void)arg;
+    for (i = 0; i < OPEN_ITERATIONS; i++) {
+        t = now_ns ();
+        if ((fd = open (filename, O_RDONLY)) < 0)
+            die ("open");
+        my_lat[i] = now_ns () - t;
+        close (fd);
+    }
+    elapsed[id] = now_ns () - start;
+}
+
+static void bench_open (unsigned long size)
+{
+    run_procs (open_proc, NULL);
+    gather (OPEN_ITERATIONS);
+    report ("open", size, 0, 0, slowest (), lat,
+            (unsigned long)OPEN_ITERATIONS * nproc);
+}
+
+static void set_nocache (int fd, int on)
+{
+    if (ioctl (fd, TEM_SET_NOCACHE, &on) < 0)
+        die ("TEM_SET_NOCACHE");
+}
+
+/**
+ * Links the cache lines of a working set of size bytes into one random
+ * cycle, so following it touches every line in an order the prefetcher
+ * cannot guess.
+ */
+static void **make_chase (unsigned long size)
+{
+    unsigned long lines = size / CACHE_LINE;
+    unsigned long stride = CACHE_LINE / sizeof(void *);
+    unsigned long i, j, t, *next;
+    void **set;
+
+    if (posix_memalign ((void **)&set, 4096, size) != 0)
+        die ("posix_memalign");
+    if ((next = malloc (lines * sizeof(*next))) == NULL)
+        die ("malloc");
+
+    // Sattolo's shuffle, which leaves a single cycle through every line
+    for (i = 0; i < lines; i++)
+        next[i] = i;
+    for (i = lines - 1; i > 0; i--) {
+        j = random () % i;
+        t = next[i];
+        next[i] = next[j];
+        next[j] = t;
+    }
+    for (i = 0; i < lines; i++)
+        set[i * stride] = &set[next[i] * stride];
+    free (next);
+    return set;
+}
+
+/**
+ * Follows the chain for CHASE_ROUNDS rounds and returns the median time of
+ * one load in ns.
+ */
+static double chase (void **set)
+{
+    uint64_t rounds[CHASE_ROUNDS], start;
+    void **p = set;
+    unsigned long i;
+    int r;
+
+    for (r = 0; r < CHASE_ROUNDS; r++) {
+        start = now_ns ();
+        for (i = 0; i < CHASE_STEPS; i++)
+            p = *p;
+        rounds[r] = now_ns () - start;
+    }
+    chase_sink = p;
+    qsort (rounds, CHASE_ROUNDS, sizeof(uint64_t), cmp_u64);
+    return (double)rounds[CHASE_ROUNDS / 2] / CHASE_STEPS;
+}
+
+struct stream_args {
+    int write, nocache;
+    unsigned long size, bs;
+};
+
+/**
+ * Reads or writes the process's own slice of the device over and over until
+ * told to stop, counting the bytes moved.
+ */
+static void stream_proc (int id, void *arg)
+{
+    struct stream_args *a = arg;
+    unsigned long slice = a->size / nproc / a->bs * a->bs;
+    uint64_t start = now_ns ();
+    off_t pos, done = 0;
+    ssize_t result;
+    char *buf;
+    int fd = open_device (O_RDWR);
+
+    set_nocache (fd, a->nocache);
+    if (posix_memalign ((void **)&buf, 4096, a->bs) != 0)
+        die ("posix_memalign");
+    memset (buf, id, a->bs);
+
+    streamed[id] = 0;
+    while (!*stream_stop) {
+        pos = (off_t)id * slice + done % slice;
+        if (a->write)
+            result = pwrite (fd, buf, a->bs, pos);
+        else
+            result = pread (fd, buf, a->bs, pos);
+        if (result != (ssize_t)a->bs) {
+            fprintf (stderr, "streaming %lu bytes at %lld returned %zd\n",
+                     a->bs, (long long)pos, result);
+            exit (1);
+        }
+        done += a->bs;
+    }
+    streamed[id] = done;
+    elapsed[id] = now_ns () - start;
+    close (fd);
+}
+
+/**
+ * Reads the device through for STREAM_BYTES and returns how long it took.
+ */
+static uint64_t time_read (unsigned long size, unsigned long bs, int nocache,
+                           char *buf)
+{
+    unsigned long blocks = size / bs, i;
+    uint64_t start, ns;
+    int fd = open_device (O_RDONLY);
+
+    set_nocache (fd, nocache);
+    start = now_ns ();
+    for (i = 0; i < STREAM_BYTES / bs; i++) {
+        if (pread (fd, buf, bs, (off_t)(i % blocks) * bs) != (ssize_t)bs)
+            die ("pread");
+    }
+    ns = now_ns () - start;
+    close (fd);
+    return ns;
+}
+
+/**
+ * Times the pointer chase alone and then alongside nproc processes reading
+ * or writing the device in large blocks, with and without nocache, and
+ * reports how much slower the chase got. Then reads the device in one
+ * process with and without nocache and reports what flushing each line
+ * after a read cost.
+ */
+static void bench_colocated (unsigned long size)
+{
+    static const char *names[] = { "colocated_read", "colocated_write" };
+    unsigned long bs = size / nproc < STREAM_BLOCK ? size / nproc / 4096 * 4096
+                                                   : STREAM_BLOCK;
+    struct stream_args a;
+    uint64_t bytes, cached_ns, nocache_ns;
+    double alone, loaded;
+    void **set;
+    char *buf;
+    int p;
+
+    if (bs == 0)
+        return;
+    set = make_chase (cache_size);
+    alone = chase (set);
+
+    a.size = size;
+    a.bs = bs;
+    for (a.write = 0; a.write <= 1; a.write++) {
+        for (a.nocache = 0; a.nocache <= 1; a.nocache++) {
+            *stream_stop = 0;
+            start_procs (stream_proc, &a);
+            // let the streamers get going before timing the chase
+            usleep (20000);
+            loaded = chase (set);
+            *stream_stop = 1;
+            wait_procs ();
+
+            for (bytes = 0, p = 0; p < nproc; p++)
+                bytes += streamed[p];
+            fprintf (out, "%s\n    {\"test\": \"%s\", \"device_size\": %lu, "
+                     "\"block_size\": %lu, \"nproc\": %d, \"nocache\": %d, "
+                     "\"cache_size\": %lu, \"alone_ns_per_load\": %.2f, "
+                     "\"ns_per_load\": %.2f, \"slowdown\": %.3f, "
+                     "\"stream_mb_per_s\": %.2f}",
+                     first_result ? "" : ",", names[a.write], size, bs,
+                     nproc, a.nocache, cache_size, alone, loaded,
+                     loaded / alone, bytes / (slowest () / 1e9) / (1 << 20));
+            first_result = 0;
+        }
+    }
+    free (set);
+
+    if (posix_memalign ((void **)&buf, 4096, bs) != 0)
+        die ("posix_memalign");
+    cached_ns = time_read (size, bs, 0, buf);
+    nocache_ns = time_read (size, bs, 1, buf);
+    bytes = STREAM_BYTES / bs * bs;
+    fprintf (out, "%s\n    {\"test\": \"read_flush\", \"device_size\": %lu, "
+             "\"block_size\": %lu, \"bytes\": %llu, \"mb_per_s\": %.2f, "
+             "\"nocache_mb_per_s\": %.2f, \"ns_per_line\": %.3f}",
+             first_result ? "" : ",", size, bs, (unsigned long long)bytes,
+             bytes / (cached_ns / 1e9) / (1 << 20),
+             bytes / (nocache_ns / 1e9) / (1 << 20),
+             ((double)nocache_ns - cached_ns) / (bytes / CACHE_LINE));
+    first_result = 0;
+    fflush (out);
+    free (buf);
+}
+
+static void usage (char *prog)
+{
+    fprintf (stderr, "usage: %s [-d device] [-s sizes] [-b block sizes] "
+             "[-p processes] [-n max ops] [-N] [-C cache size] "
+             "[-o output.json]\n"
+             "  sizes are comma separated, e.g. -s 1M,64M -b 512,4K,64K\n"
+             "  -N bypasses the cpu cache for large transfers\n"
+             "  -C also times a workload over that much cache alongside "
+             "streaming\n", prog);
+    exit (1);
+}
+
+int main (int argc, char **argv)
+{
+    char default_sizes[] = "1M,16M", default_blocks[] = "512,4K,64K,1M";
+    int i, j, opt, fd, max_nprocs;
+
+    out = stdout;
+    while ((opt = getopt (argc, argv, "d:s:b:p:n:NC:o:h")) != -1) {
+        switch (opt) {
+            case 'd': filename = optarg; break;
+            case 's': nr_device_sizes = parse_size_list (optarg, device_sizes);
+                      break;
+            case 'b': nr_block_sizes = parse_size_list (optarg, block_sizes);
+                      break;
+            case 'p': nproc = atoi (optarg); break;
+            case 'n': max_ops = parse_size (optarg); break;
+            case 'N': nocache = 1; break;
+            case 'C': cache_size = parse_size (optarg); break;
+            case 'o':
+                if ((out = fopen (optarg, "w")) == NULL)
+                    die ("fopen");
+                break;
+            default: usage (argv[0]);
+        }
+    }
+    if (nr_device_sizes == 0)
+        nr_device_sizes = parse_size_list (default_sizes, device_sizes);
+    if (nr_block_sizes == 0)
+        nr_block_sizes = parse_size_list (default_blocks, block_sizes);
+    if (nproc < 1 || max_ops == 0 || (cache_size && cache_size < CACHE_LINE))
+        usage (argv[0]);
+
+    // this process keeps the device open and each worker opens it again
+    fd = open_device (O_RDONLY);
+    max_nprocs = nproc + 2;
+    if (ioctl (fd, TEM_SET_NPROC, &max_nprocs) < 0)
+        die ("TEM_SET_NPROC");
+
+    lat_slots = max_ops > OPEN_ITERATIONS ? max_ops : OPEN_ITERATIONS;
+    lat = mmap (NULL, lat_slots * nproc * sizeof(uint64_t),
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    elapsed = mmap (NULL, nproc * sizeof(uint64_t), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    streamed = mmap (NULL, nproc * sizeof(uint64_t) + sizeof(int),
+                     PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (lat == MAP_FAILED || elapsed == MAP_FAILED || streamed == MAP_FAILED)
+        die ("mmap");
+    stream_stop = (volatile int *)(streamed + nproc);
+
+    fprintf (out, "{\"device\": \"%s\", \"nproc\": %d, \"nocache\": %d, "
+             "\"page_size\": %ld, \"results\": [", filename, nproc, nocache,
+             sysconf (_SC_PAGESIZE));
+    for (i = 0; i < nr_device_sizes; i++) {
+        fill_device (device_sizes[i]);
+        for (j = 0; j < nr_block_sizes; j++)
+            bench_rw (device_sizes[i], block_sizes[j]);
+        bench_mmap (device_sizes[i]);
+        bench_open (device_sizes[i]);
+        if (cache_size)
+            bench_colocated (device_sizes[i]);
+    }
+    fprintf (out, "\n]}\n");
+
+    close (fd);
+    return 0;
+}
@@ -0,0 +1,24 @@
+/**
+ * File: asgn1_fadvise.h
+ *
+ * The fadvise ioctl of asgn1 in ramdisk mode. This kernel does not pass
+ * posix_fadvise(2) hints on to drivers, so they are given to the device with
+ * TEM_FADVISE instead, taking the same range and POSIX_FADV_* advice.
+ */
+
+#ifndef ASGN1_FADVISE_H
+#define ASGN1_FADVISE_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+struct asgn1_fadvise {
+    __s64 offset;
+    __s64 len;            /* 0 means up to the end of the device */
+    int advice;           /* one of POSIX_FADV_* */
+};
+
+#define FADVISE_OP 7
+#define TEM_FADVISE _IOW('k', FADVISE_OP, struct asgn1_fadvise)
+
+#endif /* ASGN1_FADVISE_H */
@@ -0,0 +1,1233 @@
+/**
+ * File: asgn1_main.c
+ * Date: 13/03/2011
+ * Author: Edward Hills 
+ * Version: 0.9
+ *
+ * This is a module which serves as a virtual ramdisk which disk size is
+ * limited by the amount of memory available and serves as the requirement for
+ * COSC440 assignment 1 in 2012.
+ *
+ * Note: multiple devices and concurrent modules are not supported in this
+ *       version.
+ */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/list.h>
+#include <asm/uaccess.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/proc_fs.h>
+#include <linux/device.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/mutex.h>
+#include <linux/log2.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+#include <linux/highmem.h>
+#include <linux/genhd.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/uaccess.h>
+#include <linux/fadvise.h>
+#include <linux/string.h>
+
+#include "asgn1_ring.h"
+#include "asgn1_fadvise.h"
+#include "asgn1_store.h"
+#include "asgn1_selftest.h"
+
+#define MYDEV_NAME "asgn1"
+#define MYBLK_NAME "asgn1blk"
+#define MYIOC_TYPE 'k'
+
+#define FAULT_AROUND_PAGES 16      /* pages mapped per fault by default */
+#define FAULT_AROUND_SEQ_PAGES 64  /* pages mapped per sequential fault */
+
+#define ASGN1_MODE_RAMDISK 0     /* random access ramdisk */
+#define ASGN1_MODE_FIFO 1        /* reads consume what writes append */
+#define ASGN1_MODE_RING 2        /* mmapped ring driven from userspace */
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Edward Hills");
+MODULE_DESCRIPTION("COSC440 asgn1");
+
+/**
+ * Per open file state, kept in filp->private_data.
+ */
+typedef struct asgn1_file_t {
+    int nocache;          /* bypass the cpu cache for large transfers */
+    int noreuse;          /* POSIX_FADV_NOREUSE given, which does the same */
+    int advice;           /* last POSIX_FADV_* access pattern given */
+    asgn1_cursor cursor;  /* last page node read or written */
+} asgn1_file;
+
+typedef struct asgn1_dev_t {
+    dev_t dev;            /* the device */
+    struct cdev *cdev;
+    asgn1_store store;    /* the pages holding the data */
+    atomic_t nprocs;      /* number of processes accessing this device */ 
+    atomic_t max_nprocs;  /* max number of processes accessing this device */
+    struct class *class;     /* the udev class */
+    struct device *device;   /* the udev device node */
+    struct mutex mutex;      /* serialises readers and writers in fifo mode */
+    size_t fifo_head;     /* offset of the first unread byte in fifo mode */
+    size_t fifo_max;      /* most unread bytes the fifo will hold */
+    wait_queue_head_t readq;   /* readers waiting for data */
+    wait_queue_head_t writeq;  /* writers waiting for space */
+    struct asgn1_ring_ctrl *ring;  /* control page in ring mode */
+    struct request_queue *blk_queue;  /* the block device queue */
+    struct gendisk *blk_disk;         /* the block device */
+} asgn1_dev;
+
+asgn1_dev asgn1_device;
+
+int asgn1_major = 0;                      /* major number of module */  
+int asgn1_minor = 0;                      /* minor number of module */
+int asgn1_dev_count = 1;                  /* number of devices */
+
+int asgn1_mode = ASGN1_MODE_RAMDISK;     /* how the pages are used */
+int asgn1_fifo_max_pages = 256;          /* fifo high watermark in pages */
+int asgn1_ring_pages = 64;               /* data pages in ring mode */
+int asgn1_blk_pages = 0;                 /* block device size in pages */
+int asgn1_blk_major = 0;                 /* major number of block device */
+int asgn1_nocache = 0;                   /* default for newly opened files */
+int asgn1_nocache_min = 64 * 1024;       /* smallest transfer to stream */
+int asgn1_selftest_level = 0;            /* self tests to run on loading */
+
+module_param(asgn1_major, int, S_IRUGO);
+MODULE_PARM_DESC(asgn1_major, "device major number");
+module_param(asgn1_mode, int, S_IRUGO);
+MODULE_PARM_DESC(asgn1_mode, "0 = ramdisk, 1 = fifo stream, 2 = mmapped ring");
+module_param(asgn1_fifo_max_pages, int, S_IRUGO);
+MODULE_PARM_DESC(asgn1_fifo_max_pages, "pages of unread data before fifo writers block");
+module_param(asgn1_ring_pages, int, S_IRUGO);
+MODULE_PARM_DESC(asgn1_ring_pages, "data pages in ring mode, a power of two");
+module_param(asgn1_blk_pages, int, S_IRUGO);
+MODULE_PARM_DESC(asgn1_blk_pages, "size of the " MYBLK_NAME " block device in pages, 0 for none");
+module_param(asgn1_nocache, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(asgn1_nocache, "bypass the cpu cache for large reads and writes on newly opened files");
+module_param(asgn1_nocache_min, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(asgn1_nocache_min, "smallest read or write in bytes that bypasses the cpu cache");
+module_param_named(asgn1_selftest, asgn1_selftest_level, int, S_IRUGO);
+MODULE_PARM_DESC(asgn1_selftest, "1 = test the page store on loading, 2 = also benchmark it");
+
+/**
+ * This function opens the virtual disk, if it is opened in the write-only
+ * mode, all memory pages will be freed. That fails with -EBUSY while the
+ * device is mapped.
+ */
+int asgn1_open(struct inode *inode, struct file *filp) {
+    asgn1_file *file_data;
+    int result;
+
+    // check there arent too many proccesses already
+    if (atomic_read(&asgn1_device.nprocs) >= atomic_read(&asgn1_device.max_nprocs)) {
+        printk(KERN_ERR "(exit): Too many processes are accessing this device\n");
+        return -EBUSY;
+    }
+
+    // if opened in write only free everything we had previously, unless
+    // we are a fifo or ring in which case the producer must not drop
+    // unread data, or the block device is using the pages
+    if ((filp->f_flags & O_ACCMODE) == O_WRONLY &&
+            asgn1_mode == ASGN1_MODE_RAMDISK && asgn1_blk_pages == 0) {
+        if ((result = truncate_store(&asgn1_device.store)) < 0) {
+            printk(KERN_ERR "(open): Cannot empty the device while it is mapped\n");
+            return result;
+        }
+    }
+
+    if ((file_data = kmalloc(sizeof(asgn1_file), GFP_KERNEL)) == NULL) {
+        return -ENOMEM;
+    }
+    file_data->nocache = asgn1_nocache;
+    file_data->noreuse = 0;
+    file_data->advice = POSIX_FADV_NORMAL;
+    file_data->cursor.node = NULL;
+    filp->private_data = file_data;
+    atomic_inc(&asgn1_device.nprocs);
+
+    printk(KERN_INFO " attempting to open device: %s\n", MYDEV_NAME);
+    printk(KERN_INFO " MAJOR number = %d, MINOR number = %d\n",
+            imajor(inode), iminor(inode));
+    return 0;
+}
+
+
+/*
+ * This function releases the virtual disk, freeing the per file state.
+ */
+int asgn1_release (struct inode *inode, struct file *filp) {
+
+    kfree(filp->private_data);
+    atomic_dec(&asgn1_device.nprocs);
+    printk(KERN_INFO " closing character device: %s\n\n", MYDEV_NAME);
+    return 0;
+}
+
+
+/**
+ * Whether a transfer of count bytes should bypass the cpu cache, as asked
+ * for with the nocache ioctl or POSIX_FADV_NOREUSE. Only large transfers
+ * do, as the data is not expected to be touched again soon.
+ */
+static int want_nocache(struct file *filp, size_t count) {
+    asgn1_file *file_data = filp->private_data;
+
+    return (file_data->nocache || file_data->noreuse) &&
+        count >= (size_t)asgn1_nocache_min;
+}
+
+/**
+ * Number of bytes written to the fifo that have not been read yet.
+ */
+static size_t fifo_unread(void) {
+    return asgn1_device.store.data_size - asgn1_device.fifo_head;
+}
+
+/**
+ * Number of bytes that can be written to the fifo before reaching the high
+ * watermark.
+ */
+static size_t fifo_space(void) {
+    size_t unread = fifo_unread();
+
+    return unread < asgn1_device.fifo_max ? asgn1_device.fifo_max - unread : 0;
+}
+
+/**
+ * This function reads from the front of the fifo, consuming the data. Pages
+ * that have been read in full are given back to the allocator straight away.
+ * Blocks until there is data unless the file is non-blocking.
+ */
+ssize_t asgn1_fifo_read(struct file *filp, char __user *buf, size_t count) {
+    size_t size_read = 0;     /* size read from the fifo in this function */
+    size_t size_to_be_read;   /* size to be read from the current page */
+    size_t not_copied;        /* size copy_to_user could not read */
+    page_node *curr;
+
+    if (count == 0) {
+        return 0;
+    }
+
+    if (mutex_lock_interruptible(&asgn1_device.mutex)) {
+        return -ERESTARTSYS;
+    }
+
+    // wait until a writer gives us something to read
+    while (fifo_unread() == 0) {
+        mutex_unlock(&asgn1_device.mutex);
+        if (filp->f_flags & O_NONBLOCK) {
+            return -EAGAIN;
+        }
+        if (wait_event_interruptible(asgn1_device.readq, fifo_unread() > 0)) {
+            return -ERESTARTSYS;
+        }
+        if (mutex_lock_interruptible(&asgn1_device.mutex)) {
+            return -ERESTARTSYS;
+        }
+    }
+
+    count = min(count, fifo_unread());
+    while (size_read < count) {
+        curr = list_entry(asgn1_device.store.mem_list.next, page_node, list);
+        size_to_be_read = min_t(size_t, PAGE_SIZE - asgn1_device.fifo_head,
+                count - size_read);
+        not_copied = copy_to_user(buf + size_read, page_address(curr->page)
+                + asgn1_device.fifo_head, size_to_be_read);
+        size_read += size_to_be_read - not_copied;
+        asgn1_device.fifo_head += size_to_be_read - not_copied;
+
+        // the whole page has been consumed so give it back
+        if (asgn1_device.fifo_head == PAGE_SIZE) {
+            free_first_page(&asgn1_device.store);
+            asgn1_device.fifo_head = 0;
+        }
+
+        if (not_copied) {
+            break;
+        }
+    }
+    mutex_unlock(&asgn1_device.mutex);
+
+    if (size_read == 0) {
+        return -EFAULT;
+    }
+
+    wake_up_interruptible(&asgn1_device.writeq);
+    return size_read;
+}
+
+/**
+ * This function appends to the end of the fifo. Blocks while the fifo is at
+ * its high watermark unless the file is non-blocking.
+ */
+ssize_t asgn1_fifo_write(struct file *filp, const char __user *buf,
+        size_t count) {
+    size_t size_written = 0;  /* size written to the fifo in this function */
+    size_t begin_offset;      /* the offset into the last page to start at */
+    size_t size_to_be_written;  /* size to be written to the current page */
+    size_t not_copied;        /* size copy_from_user could not write */
+    ssize_t result = -EFAULT; /* what to return if nothing was written */
+    page_node *curr;
+
+    if (count == 0) {
+        return 0;
+    }
+
+    if (mutex_lock_interruptible(&asgn1_device.mutex)) {
+        return -ERESTARTSYS;
+    }
+
+    // wait until a reader makes some room
+    while (fifo_space() == 0) {
+        mutex_unlock(&asgn1_device.mutex);
+        if (filp->f_flags & O_NONBLOCK) {
+            return -EAGAIN;
+        }
+        if (wait_event_interruptible(asgn1_device.writeq, fifo_space() > 0)) {
+            return -ERESTARTSYS;
+        }
+        if (mutex_lock_interruptible(&asgn1_device.mutex)) {
+            return -ERESTARTSYS;
+        }
+    }
+
+    count = min(count, fifo_space());
+    while (size_written < count) {
+        if (asgn1_device.store.data_size ==
+                asgn1_device.store.num_pages * PAGE_SIZE) {
+            // last page is full so better get a new one!
+            if (add_memory_page(&asgn1_device.store) == NULL) {
+                printk(KERN_ERR "Not enough memory left\n");
+                result = -ENOMEM;
+                break;
+            }
+        }
+
+        curr = list_entry(asgn1_device.store.mem_list.prev, page_node, list);
+        begin_offset = asgn1_device.store.data_size % PAGE_SIZE;
+        size_to_be_written = min_t(size_t, PAGE_SIZE - begin_offset,
+                count - size_written);
+        not_copied = copy_from_user(page_address(curr->page) + begin_offset,
+                buf + size_written, size_to_be_written);
+        size_written += size_to_be_written - not_copied;
+        asgn1_device.store.data_size += size_to_be_written - not_copied;
+
+        if (not_copied) {
+            break;
+        }
+    }
+    mutex_unlock(&asgn1_device.mutex);
+
+    if (size_written == 0) {
+        return result;
+    }
+
+    wake_up_interruptible(&asgn1_device.readq);
+    return size_written;
+}
+
+
+/**
+ * This function allocates the control page and data pages of the ring and
+ * fills in the control page. Records are exchanged through mmap only.
+ */
+int asgn1_ring_setup(void) {
+    page_node *curr;
+    int i;
+
+    for (i = 0; i < 1 + asgn1_ring_pages; i++) {
+        if ((curr = add_memory_page(&asgn1_device.store)) == NULL) {
+            free_memory_pages(&asgn1_device.store);
+            return -ENOMEM;
+        }
+        clear_page(page_address(curr->page));
+    }
+    asgn1_device.store.data_size = asgn1_device.store.num_pages * PAGE_SIZE;
+
+    curr = list_entry(asgn1_device.store.mem_list.next, page_node, list);
+    asgn1_device.ring = page_address(curr->page);
+    asgn1_device.ring->magic = ASGN1_RING_MAGIC;
+    asgn1_device.ring->data_pages = asgn1_ring_pages;
+    asgn1_device.ring->data_size = (u64)asgn1_ring_pages * PAGE_SIZE;
+    return 0;
+}
+
+/**
+ * Bytes waiting in the ring. Userspace owns the indices so only trust them
+ * as far as deciding whether to sleep.
+ */
+static u64 ring_used(void) {
+    u64 head = ACCESS_ONCE(asgn1_device.ring->head);
+    u64 tail = ACCESS_ONCE(asgn1_device.ring->tail);
+
+    smp_rmb();
+    return head - tail;
+}
+
+static u64 ring_space(void) {
+    u64 size = (u64)asgn1_ring_pages * PAGE_SIZE;
+    u64 used = ring_used();
+
+    return used < size ? size - used : 0;
+}
+
+
+/**
+ * This function reads contents of the virtual disk and writes to the user 
+ */
+ssize_t asgn1_read(struct file *filp, char __user *buf, size_t count,
+        loff_t *f_pos) {
+    asgn1_file *file_data = filp->private_data;
+    ssize_t size_read;
+
+    if (asgn1_mode == ASGN1_MODE_FIFO) {
+        return asgn1_fifo_read(filp, buf, count);
+    } else if (asgn1_mode == ASGN1_MODE_RING) {
+        return -EINVAL;
+    }
+
+    if (*f_pos >= asgn1_device.store.data_size) {
+        printk(KERN_ERR "Reached end of the device on a read");
+        return 0;
+    }
+
+    size_read = store_read(&asgn1_device.store, &file_data->cursor, buf,
+            count, *f_pos, want_nocache(filp, count));
+    if (size_read > 0) {
+        printk(KERN_INFO "Read %d bytes\n", (int)size_read);
+        *f_pos += size_read;
+    }
+    return size_read;
+}
+
+/**
+ * This function allows the user to seek to a certain position in the
+ * device from the position specified in the cmd parameter.
+ */
+static loff_t asgn1_lseek (struct file *file, loff_t offset, int cmd)
+{
+    loff_t testpos;
+
+    // a fifo is always read from the front and written at the back
+    if (asgn1_mode == ASGN1_MODE_FIFO) {
+        return -ESPIPE;
+    }
+
+    testpos = store_seek(&asgn1_device.store, file->f_pos, offset, cmd);
+    if (testpos < 0) {
+        return testpos;
+    }
+    file->f_pos = testpos;
+
+    printk (KERN_INFO "Seeking to pos=%ld\n", (long)testpos);
+    return testpos;
+}
+
+
+/**
+ * This function writes from the user buffer to the virtual disk of this
+ * module
+ */
+ssize_t asgn1_write(struct file *filp, const char __user *buf, size_t count,
+        loff_t *f_pos) {
+    asgn1_file *file_data = filp->private_data;
+    ssize_t size_written;
+
+    if (asgn1_mode == ASGN1_MODE_FIFO) {
+        return asgn1_fifo_write(filp, buf, count);
+    } else if (asgn1_mode == ASGN1_MODE_RING) {
+        return -EINVAL;
+    }
+
+    size_written = store_write(&asgn1_device.store, &file_data->cursor, buf,
+            count, *f_pos, want_nocache(filp, count));
+    if (size_written > 0) {
+        *f_pos += size_written;
+        printk(KERN_ERR "Wrote %d bytes\n", (int)size_written);
+    }
+    return size_written;
+} 
+
+#define SET_NPROC_OP 1
+#define TEM_SET_NPROC _IOW(MYIOC_TYPE, SET_NPROC_OP, int) 
+#define SET_FIFO_MAX_OP 2
+#define TEM_SET_FIFO_MAX _IOW(MYIOC_TYPE, SET_FIFO_MAX_OP, int) 
+#define SET_NOCACHE_OP 6
+#define TEM_SET_NOCACHE _IOW(MYIOC_TYPE, SET_NOCACHE_OP, int) 
+
+/**
+ * Handles access pattern hints the way posix_fadvise(2) would if this
+ * kernel passed them on to the driver. WILLNEED fills any holes in the range
+ * so later writes and faults do not have to allocate, DONTNEED turns pages
+ * of zeroes back into holes, NOREUSE streams large transfers past the cpu
+ * cache and the rest pick how many pages a mapping fault maps.
+ */
+long asgn1_fadvise(struct file *filp, loff_t offset, loff_t len, int advice) {
+    asgn1_file *file_data = filp->private_data;
+    loff_t end;               /* the end of the range in bytes */
+    unsigned long index;      /* the current page number */
+    unsigned long last;       /* the page number after the range */
+    page_node *curr;
+    struct page *page;
+
+    if (asgn1_mode != ASGN1_MODE_RAMDISK || offset < 0 || len < 0) {
+        return -EINVAL;
+    }
+
+    // the range must not wrap around
+    if (len > LLONG_MAX - offset) {
+        return -EINVAL;
+    }
+
+    end = (loff_t)asgn1_device.store.num_pages * PAGE_SIZE;
+    if (len != 0 && offset + len < end) {
+        end = offset + len;
+    }
+
+    switch (advice) {
+        case POSIX_FADV_NORMAL:
+            // only undoes NOREUSE, not the nocache ioctl
+            file_data->noreuse = 0;
+            file_data->advice = advice;
+            break;
+        case POSIX_FADV_RANDOM:
+        case POSIX_FADV_SEQUENTIAL:
+            file_data->advice = advice;
+            break;
+        case POSIX_FADV_NOREUSE:
+            file_data->noreuse = 1;
+            break;
+        case POSIX_FADV_WILLNEED:
+            // every page touching the range
+            if (offset >= end) {
+                break;
+            }
+            index = offset >> PAGE_SHIFT;
+            last = min_t(unsigned long, (end + PAGE_SIZE - 1) >> PAGE_SHIFT,
+                    asgn1_device.store.num_pages);
+            if (index >= last) {
+                break;
+            }
+            curr = find_page_node(&asgn1_device.store, index, NULL);
+            for (; index < last; index++) {
+                if ((page = get_node_page(&asgn1_device.store, curr, 1,
+                                GFP_KERNEL)) == NULL) {
+                    return -ENOMEM;
+                }
+                put_page(page);
+                curr = list_entry(curr->list.next, page_node, list);
+            }
+            break;
+        case POSIX_FADV_DONTNEED:
+            // only pages wholly inside the range
+            if (offset >= end) {
+                break;
+            }
+            index = (offset + PAGE_SIZE - 1) >> PAGE_SHIFT;
+            last = min_t(unsigned long, end >> PAGE_SHIFT,
+                    asgn1_device.store.num_pages);
+            if (index >= last) {
+                break;
+            }
+            curr = find_page_node(&asgn1_device.store, index, NULL);
+            for (; index < last; index++) {
+                discard_zero_page(&asgn1_device.store, curr);
+                curr = list_entry(curr->list.next, page_node, list);
+            }
+            break;
+        default:
+            return -EINVAL;
+    }
+    return 0;
+}
+
+/**
+ * The ioctl function, which nothing needs to be done in this case.
+ */
+long asgn1_ioctl (struct file *filp, unsigned int cmd, unsigned long arg) {
+    int nr;
+    int new_nprocs;
+    int new_fifo_max;
+    int wanted_space;
+    int nocache;
+    struct asgn1_fadvise fadvise;
+    int result;
+
+    // check that the command is actually for my type of device
+    if (_IOC_TYPE(cmd) != MYIOC_TYPE) {
+        printk(KERN_WARNING "Invalid comand CMD=%d, for this type.\n", cmd);
+        return -EINVAL;
+    }
+
+    nr = _IOC_NR(cmd);
+    if (nr == SET_NPROC_OP) {
+        if(get_user(new_nprocs, (int *)arg) != 0) {
+            printk(KERN_ERR "Cannot read arg value.\n");
+            return -1;
+        }
+
+        // make sure im not lowering maxprocs when more processes are accessing this device
+        if (new_nprocs < atomic_read(&asgn1_device.nprocs) ) {
+            printk(KERN_ERR "Cannot set maximum number of processes to %d because too many processes are currently accessing this device.\n", new_nprocs);
+            result = -1;
+        } else {
+            atomic_set(&asgn1_device.max_nprocs, new_nprocs);
+            result = 0;
+        }
+        return result;
+    } else if (nr == SET_FIFO_MAX_OP) {
+        if (get_user(new_fifo_max, (int *)arg) != 0) {
+            printk(KERN_ERR "Cannot read arg value.\n");
+            return -EFAULT;
+        }
+
+        if (new_fifo_max <= 0) {
+            printk(KERN_ERR "Fifo high watermark must be at least one page.\n");
+            return -EINVAL;
+        }
+
+        mutex_lock(&asgn1_device.mutex);
+        asgn1_device.fifo_max = (size_t)new_fifo_max * PAGE_SIZE;
+        mutex_unlock(&asgn1_device.mutex);
+
+        // raising the watermark may let blocked writers carry on
+        wake_up_interruptible(&asgn1_device.writeq);
+        return 0;
+    } else if (nr == SET_NOCACHE_OP) {
+        if (get_user(nocache, (int *)arg) != 0) {
+            printk(KERN_ERR "Cannot read arg value.\n");
+            return -EFAULT;
+        }
+
+        // only this open file is affected
+        ((asgn1_file *)filp->private_data)->nocache = nocache != 0;
+        return 0;
+    } else if (nr == FADVISE_OP) {
+        if (copy_from_user(&fadvise, (void __user *)arg, sizeof(fadvise))) {
+            printk(KERN_ERR "Cannot read arg value.\n");
+            return -EFAULT;
+        }
+        return asgn1_fadvise(filp, fadvise.offset, fadvise.len,
+                fadvise.advice);
+    } else if (nr == RING_WAIT_DATA_OP || nr == RING_WAIT_SPACE_OP ||
+            nr == RING_KICK_OP) {
+        if (asgn1_mode != ASGN1_MODE_RING) {
+            return -EINVAL;
+        }
+
+        if (nr == RING_WAIT_DATA_OP) {
+            return wait_event_interruptible(asgn1_device.readq,
+                    ring_used() > 0);
+        } else if (nr == RING_WAIT_SPACE_OP) {
+            if (get_user(wanted_space, (int *)arg) != 0) {
+                printk(KERN_ERR "Cannot read arg value.\n");
+                return -EFAULT;
+            }
+            if (wanted_space <= 0 ||
+                    (u64)wanted_space > (u64)asgn1_ring_pages * PAGE_SIZE) {
+                return -EINVAL;
+            }
+            return wait_event_interruptible(asgn1_device.writeq,
+                    ring_space() >= (u64)wanted_space);
+        }
+
+        // the other side published something and saw us waiting
+        wake_up_interruptible(&asgn1_device.readq);
+        wake_up_interruptible(&asgn1_device.writeq);
+        return 0;
+    }
+
+    printk(KERN_WARNING "Invalid comand nr=%d, for this type.\n", nr);
+    return -ENOTTY;
+}
+
+
+/**
+ * Reports whether the fifo can be read from or written to without blocking.
+ * In ring mode this is whether there are records or free space in the ring,
+ * which is only re-evaluated when a side kicks. A ramdisk can always be read
+ * and written.
+ */
+unsigned int asgn1_poll(struct file *filp, poll_table *wait) {
+    unsigned int mask = 0;
+
+    if (asgn1_mode == ASGN1_MODE_RAMDISK) {
+        return POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM;
+    } else if (asgn1_mode == ASGN1_MODE_RING) {
+        poll_wait(filp, &asgn1_device.readq, wait);
+        poll_wait(filp, &asgn1_device.writeq, wait);
+        if (ring_used() > 0) {
+            mask |= POLLIN | POLLRDNORM;
+        }
+        if (ring_space() > 0) {
+            mask |= POLLOUT | POLLWRNORM;
+        }
+        return mask;
+    }
+
+    mutex_lock(&asgn1_device.mutex);
+    poll_wait(filp, &asgn1_device.readq, wait);
+    poll_wait(filp, &asgn1_device.writeq, wait);
+
+    if (fifo_unread() > 0) {
+        mask |= POLLIN | POLLRDNORM;
+    }
+    if (fifo_space() > 0) {
+        mask |= POLLOUT | POLLWRNORM;
+    }
+    mutex_unlock(&asgn1_device.mutex);
+
+    return mask;
+}
+
+
+/**
+ * Displays information about current status of the module,
+ * which helps debugging.
+ */
+int asgn1_read_procmem(char *buf, char **start, off_t offset, int count,
+        int *eof, void *data) {
+    int result;
+
+    // write data about this device to proc
+    result = snprintf(buf + offset, count + 1, "Character device driver: %s\n", MYDEV_NAME);  
+    result += snprintf(buf + offset + result, count + 1, "Number of pages used: %d\n", (int)asgn1_device.store.num_pages);  
+    result += snprintf(buf + offset + result, count + 1, "Size of this device: %d\n", (int)asgn1_device.store.data_size);  
+    result += snprintf(buf + offset + result, count + 1, "Number of processess accessing this device: %d\n", (int)atomic_read(&asgn1_device.nprocs));  
+    if (asgn1_mode == ASGN1_MODE_FIFO) {
+        result += snprintf(buf + offset + result, count + 1, "Unread bytes in fifo: %d\n", (int)fifo_unread());  
+    }
+
+    // set eof so we know we are done writing
+    if (result <= offset + count) {
+        *eof = 1;
+    }
+
+    *start = buf + offset;
+    result -= offset;
+
+    if (result > count)
+        result = count;
+    if (result < 0)
+        result = 0;
+
+    return result;
+}
+
+/**
+ * Keeps count of the vmas mapping the device so discards know when pages
+ * might still be in use.
+ */
+static void asgn1_vma_open(struct vm_area_struct *vma) {
+    spin_lock(&asgn1_device.store.page_lock);
+    asgn1_device.store.nr_mappings++;
+    spin_unlock(&asgn1_device.store.page_lock);
+}
+
+static void asgn1_vma_close(struct vm_area_struct *vma) {
+    spin_lock(&asgn1_device.store.page_lock);
+    asgn1_device.store.nr_mappings--;
+    spin_unlock(&asgn1_device.store.page_lock);
+}
+
+/**
+ * Maps the faulting page and, unless madvise or fadvise said the access
+ * pattern is random, the pages after it in the same vma so a scan takes
+ * fewer faults.
+ */
+static int asgn1_vma_fault(struct vm_area_struct *vma, struct vm_fault *vmf) {
+    unsigned long addr = (unsigned long)vmf->virtual_address;
+    unsigned long nr_pages = FAULT_AROUND_PAGES;
+    unsigned long count = 0;
+    page_node *curr;
+    struct page *page;
+    int result;
+
+    // the device may have been truncated since it was mapped
+    if (vmf->pgoff >= asgn1_device.store.num_pages) {
+        return VM_FAULT_SIGBUS;
+    }
+
+    if (vma->vm_flags & VM_RAND_READ) {
+        nr_pages = 1;
+    } else if (vma->vm_flags & VM_SEQ_READ) {
+        nr_pages = FAULT_AROUND_SEQ_PAGES;
+    }
+
+    curr = find_page_node(&asgn1_device.store, vmf->pgoff, NULL);
+    while (count < nr_pages && addr < vma->vm_end) {
+        // holes need a real page before they can be mapped
+        if ((page = get_node_page(&asgn1_device.store, curr, 1,
+                        GFP_KERNEL)) == NULL) {
+            return count ? VM_FAULT_NOPAGE : VM_FAULT_OOM;
+        }
+        result = vm_insert_pfn(vma, addr, page_to_pfn(page));
+        put_page(page);
+
+        // stop at pages that are already mapped
+        if (result == -EBUSY && count > 0) {
+            break;
+        } else if (result < 0 && result != -EBUSY) {
+            return count ? VM_FAULT_NOPAGE : VM_FAULT_SIGBUS;
+        }
+
+        count++;
+        addr += PAGE_SIZE;
+        if (curr->list.next == &asgn1_device.store.mem_list) {
+            break;
+        }
+        curr = list_entry(curr->list.next, page_node, list);
+    }
+    return VM_FAULT_NOPAGE;
+}
+
+static struct vm_operations_struct asgn1_vm_ops = {
+    .open = asgn1_vma_open,
+    .close = asgn1_vma_close,
+    .fault = asgn1_vma_fault,
+};
+
+/*
+ * mmap function will map memory between the user and kernel boundary so both
+ * parties are able to access the memory. Pages are mapped as they are
+ * faulted on rather than all up front.
+ */
+static int asgn1_mmap (struct file *filp, struct vm_area_struct *vma)
+{
+    asgn1_file *file_data = filp->private_data;
+    unsigned long len = vma->vm_end - vma->vm_start;
+    int result;
+
+    // pages are freed as a fifo is read so they cannot be mapped
+    if (asgn1_mode == ASGN1_MODE_FIFO) {
+        printk(KERN_ERR "Cannot mmap the device in fifo mode.\n");
+        return -EINVAL;
+    }
+
+    if ((result = store_check_map(&asgn1_device.store, vma->vm_pgoff,
+                    len)) < 0) {
+        return result;
+    } else if (!(vma->vm_flags & VM_MAYSHARE)) {
+        // read-only shared mappings drop VM_SHARED but keep VM_MAYSHARE
+        printk(KERN_ERR "Only shared mappings of the device are supported.\n");
+        return -EINVAL;
+    }
+
+#ifdef VM_RESERVED
+    vma->vm_flags |= VM_IO | VM_PFNMAP | VM_RESERVED;
+#else
+    vma->vm_flags |= VM_IO | VM_PFNMAP | VM_DONTEXPAND | VM_DONTDUMP;
+#endif
+    if (file_data->advice == POSIX_FADV_RANDOM) {
+        vma->vm_flags |= VM_RAND_READ;
+    } else if (file_data->advice == POSIX_FADV_SEQUENTIAL) {
+        vma->vm_flags |= VM_SEQ_READ;
+    }
+
+    vma->vm_ops = &asgn1_vm_ops;
+    asgn1_vma_open(vma);
+    return 0;
+}
+
+
+struct file_operations asgn1_fops = {
+    .owner = THIS_MODULE,
+    .read = asgn1_read,
+    .write = asgn1_write,
+    .unlocked_ioctl = asgn1_ioctl,
+    .open = asgn1_open,
+    .mmap = asgn1_mmap,
+    .poll = asgn1_poll,
+    .release = asgn1_release,
+    .llseek = asgn1_lseek
+};
+
+
+/**
+ * This function copies between one bio segment and the pages behind it,
+ * which may straddle two pages of the store when the segment is not page
+ * aligned. Holes read back as zeroes and are filled in on a write.
+ */
+static int asgn1_blk_do_bvec(struct page *page, unsigned int len,
+        unsigned int off, int rw, sector_t sector) {
+    loff_t pos = (loff_t)sector << 9;   /* byte offset into the store */
+    unsigned long index;      /* the store page holding pos */
+    size_t begin_offset;      /* the offset into that page */
+    size_t size_to_copy;      /* size to copy to or from that page */
+    struct page *store_page;
+    void *mem;
+
+    while (len > 0) {
+        index = pos >> PAGE_SHIFT;
+        begin_offset = pos & ~PAGE_MASK;
+        size_to_copy = min_t(size_t, PAGE_SIZE - begin_offset, len);
+
+        // allocate before mapping the bio page as that may sleep
+        store_page = get_node_page(&asgn1_device.store,
+                asgn1_device.store.index[index], rw == WRITE, GFP_NOIO);
+        if (store_page == NULL && rw == WRITE) {
+            return -ENOMEM;
+        }
+
+        mem = kmap_atomic(page);
+        if (rw == WRITE) {
+            memcpy(page_address(store_page) + begin_offset, mem + off,
+                    size_to_copy);
+        } else if (store_page != NULL) {
+            memcpy(mem + off, page_address(store_page) + begin_offset,
+                    size_to_copy);
+            flush_dcache_page(page);
+        } else {
+            memset(mem + off, 0, size_to_copy);
+            flush_dcache_page(page);
+        }
+        kunmap_atomic(mem);
+
+        if (store_page != NULL) {
+            put_page(store_page);
+        }
+        pos += size_to_copy;
+        off += size_to_copy;
+        len -= size_to_copy;
+    }
+    return 0;
+}
+
+/**
+ * This function discards a range of the block device. Whole pages are given
+ * back to the allocator and partial pages are zeroed, so the range always
+ * reads back as zeroes afterwards.
+ */
+static void asgn1_blk_discard(sector_t sector, unsigned int size) {
+    loff_t pos = (loff_t)sector << 9;
+    unsigned long index;
+    size_t begin_offset;
+    size_t size_to_discard;
+    struct page *store_page;
+
+    while (size > 0) {
+        index = pos >> PAGE_SHIFT;
+        begin_offset = pos & ~PAGE_MASK;
+        size_to_discard = min_t(size_t, PAGE_SIZE - begin_offset, size);
+
+        if (size_to_discard == PAGE_SIZE) {
+            discard_node_page(&asgn1_device.store,
+                    asgn1_device.store.index[index]);
+        } else if ((store_page = get_node_page(&asgn1_device.store,
+                        asgn1_device.store.index[index], 0,
+                        GFP_NOIO)) != NULL) {
+            memset(page_address(store_page) + begin_offset, 0,
+                    size_to_discard);
+            put_page(store_page);
+        }
+        pos += size_to_discard;
+        size -= size_to_discard;
+    }
+}
+
+/**
+ * Handles bios for the block device straight from the submitter, so there is
+ * no queue or lock to share between CPUs.
+ */
+static void asgn1_make_request(struct request_queue *q, struct bio *bio) {
+    sector_t sector = bio->bi_sector;
+    struct bio_vec *bvec;
+    int err = -EIO;
+    int i;
+
+    if (sector + (bio->bi_size >> 9) > get_capacity(asgn1_device.blk_disk)) {
+        goto out;
+    }
+
+    err = 0;
+    if (unlikely(bio->bi_rw & REQ_DISCARD)) {
+        asgn1_blk_discard(sector, bio->bi_size);
+        goto out;
+    }
+
+    bio_for_each_segment(bvec, bio, i) {
+        err = asgn1_blk_do_bvec(bvec->bv_page, bvec->bv_len,
+                bvec->bv_offset, bio_data_dir(bio), sector);
+        if (err) {
+            break;
+        }
+        sector += bvec->bv_len >> 9;
+    }
+
+out:
+    bio_endio(bio, err);
+}
+
+static const struct block_device_operations asgn1_blk_fops = {
+    .owner = THIS_MODULE,
+};
+
+/**
+ * This function sets up the block device over the same page list as the
+ * character device. The list must already have been grown to the size of
+ * the block device as holes, and indexed so bios do not have to walk it.
+ */
+int asgn1_blk_setup(void) {
+    struct request_queue *queue;
+    struct gendisk *disk;
+
+    if ((asgn1_blk_major = register_blkdev(0, MYBLK_NAME)) < 0) {
+        printk(KERN_ERR "Failed to register block device\n");
+        return asgn1_blk_major;
+    }
+
+    if ((queue = blk_alloc_queue(GFP_KERNEL)) == NULL) {
+        goto fail_queue;
+    }
+    blk_queue_make_request(queue, asgn1_make_request);
+    blk_queue_max_hw_sectors(queue, 1024);
+    blk_queue_bounce_limit(queue, BLK_BOUNCE_ANY);
+    blk_queue_physical_block_size(queue, PAGE_SIZE);
+
+    // discarded ranges are guaranteed to read back as zeroes
+    queue->limits.discard_granularity = PAGE_SIZE;
+    queue->limits.max_discard_sectors = UINT_MAX;
+    queue->limits.discard_zeroes_data = 1;
+    queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, queue);
+
+    if ((disk = alloc_disk(1)) == NULL) {
+        goto fail_disk;
+    }
+    disk->major = asgn1_blk_major;
+    disk->first_minor = 0;
+    disk->fops = &asgn1_blk_fops;
+    disk->queue = queue;
+    snprintf(disk->disk_name, sizeof(disk->disk_name), MYBLK_NAME);
+    set_capacity(disk, (sector_t)asgn1_blk_pages << (PAGE_SHIFT - 9));
+
+    asgn1_device.blk_queue = queue;
+    asgn1_device.blk_disk = disk;
+    add_disk(disk);
+    return 0;
+
+fail_disk:
+    blk_cleanup_queue(queue);
+fail_queue:
+    unregister_blkdev(asgn1_blk_major, MYBLK_NAME);
+    return -ENOMEM;
+}
+
+/**
+ * Removes the block device. The pages and index are left for
+ * free_memory_pages.
+ */
+void asgn1_blk_cleanup(void) {
+    del_gendisk(asgn1_device.blk_disk);
+    put_disk(asgn1_device.blk_disk);
+    blk_cleanup_queue(asgn1_device.blk_queue);
+    unregister_blkdev(asgn1_blk_major, MYBLK_NAME);
+}
+
+
+/**
+ * Initialise the module and create the master device
+ */
+int __init asgn1_init_module(void){
+    int result;
+
+    asgn1_device.dev = MKDEV(asgn1_major, 0);
+    atomic_set(&asgn1_device.max_nprocs, 1);
+    atomic_set(&asgn1_device.nprocs, 0);
+    asgn1_device.fifo_head = 0;
+    asgn1_device.fifo_max = (size_t)asgn1_fifo_max_pages * PAGE_SIZE;
+    mutex_init(&asgn1_device.mutex);
+    init_waitqueue_head(&asgn1_device.readq);
+    init_waitqueue_head(&asgn1_device.writeq);
+
+    if (asgn1_mode != ASGN1_MODE_RAMDISK && asgn1_mode != ASGN1_MODE_FIFO &&
+            asgn1_mode != ASGN1_MODE_RING) {
+        printk(KERN_ERR "Unknown mode %d\n", asgn1_mode);
+        return -EINVAL;
+    }
+
+    if (asgn1_ring_pages <= 0 || !is_power_of_2(asgn1_ring_pages)) {
+        printk(KERN_ERR "Ring pages must be a power of two\n");
+        return -EINVAL;
+    }
+
+    // fifo and ring modes move or pin pages in ways a disk cannot follow
+    if (asgn1_blk_pages < 0 ||
+            (asgn1_blk_pages > 0 && asgn1_mode != ASGN1_MODE_RAMDISK)) {
+        printk(KERN_ERR "The block device needs ramdisk mode\n");
+        return -EINVAL;
+    }
+
+    if (asgn1_fifo_max_pages <= 0) {
+        printk(KERN_ERR "Fifo high watermark must be at least one page\n");
+        return -EINVAL;
+    }
+
+    // the self tests use stores of their own so run them before anything
+    // is set up
+    if (asgn1_selftest_level > 0 &&
+            (result = asgn1_selftest(asgn1_selftest_level > 1)) < 0) {
+        return result;
+    }
+
+    if (asgn1_major) {
+        // try register given major number
+        result = register_chrdev_region(asgn1_device.dev, asgn1_dev_count, "Eds_char_device");
+
+        if (result < 0) {
+            // uh oh didnt work better get system to allocate it
+            printk(KERN_WARNING "Can't use the major number %d; trying automatic allocation..\n", asgn1_major);
+
+            // check if system can give me a number or die
+            if ((result = alloc_chrdev_region(&asgn1_device.dev, asgn1_major, asgn1_dev_count, MYDEV_NAME)) < 0) {
+                printk(KERN_ERR "Failed to allocate character device region\n");
+                return -1;
+            }
+            asgn1_major = MAJOR(asgn1_device.dev);
+        }
+    } 
+    else {
+        // user hasnt given me a major number so ill make my own
+        if ((result = alloc_chrdev_region(&asgn1_device.dev, asgn1_major, asgn1_dev_count, MYDEV_NAME)) < 0) {
+            printk(KERN_ERR "Failed to allocate character device region\n");
+            return -1;
+        }
+        asgn1_major = MAJOR(asgn1_device.dev);
+    }
+
+    // allocate cdev
+    if (!(asgn1_device.cdev = cdev_alloc())) {
+        printk(KERN_ERR "cdev_alloc() failed.\n");
+        unregister_chrdev_region(asgn1_device.dev, asgn1_dev_count);
+        return -1;
+    }
+
+    // init cdev
+    cdev_init(asgn1_device.cdev, &asgn1_fops);
+    asgn1_device.cdev->owner = THIS_MODULE;
+
+    // initiliase page list and kmem cache
+    if ((result = init_store(&asgn1_device.store)) < 0) {
+        printk(KERN_ERR "Failed to create the page cache\n");
+        cdev_del(asgn1_device.cdev);
+        unregister_chrdev_region(asgn1_device.dev, asgn1_dev_count);
+        return result;
+    }
+
+    // the block device's pages must be in place before the character
+    // device goes live, or a write could get in first
+    if (asgn1_blk_pages > 0 && (result = fix_store_size(&asgn1_device.store,
+                    asgn1_blk_pages)) < 0) {
+        printk(KERN_ERR "Not enough memory for the block device\n");
+        destroy_store(&asgn1_device.store);
+        cdev_del(asgn1_device.cdev);
+        unregister_chrdev_region(asgn1_device.dev, asgn1_dev_count);
+        return result;
+    }
+
+    // add cdev
+    if (cdev_add(asgn1_device.cdev, asgn1_device.dev, asgn1_dev_count) < 0) {
+        printk(KERN_ERR "cdev_add() failed.\n");
+        destroy_store(&asgn1_device.store);
+        cdev_del(asgn1_device.cdev);
+        unregister_chrdev_region(asgn1_device.dev, asgn1_dev_count);
+        return -1;
+    }
+
+    // the ring lives for as long as the module does
+    if (asgn1_mode == ASGN1_MODE_RING && (result = asgn1_ring_setup()) < 0) {
+        printk(KERN_ERR "Not enough memory for the ring\n");
+        goto fail_class;
+    }
+
+    // initialise proc 
+    if (create_proc_read_entry(MYDEV_NAME, S_IRUSR | S_IRGRP | S_IROTH, NULL, asgn1_read_procmem, NULL) == NULL) {
+        printk(KERN_ERR "Error: Could not initialize /proc/%s/\n", MYDEV_NAME);
+        result = -ENOMEM;
+        goto fail_class;
+    }
+
+    // create class
+    asgn1_device.class = class_create(THIS_MODULE, MYDEV_NAME);
+    if (IS_ERR(asgn1_device.class)) {
+        printk(KERN_WARNING "%s: can't create udev class\n", MYDEV_NAME);
+        result = -ENOMEM;
+        goto fail_class;
+    }
+
+    // create device
+    asgn1_device.device = device_create(asgn1_device.class, NULL, 
+            asgn1_device.dev, "%s", MYDEV_NAME);
+    if (IS_ERR(asgn1_device.device)) {
+        printk(KERN_WARNING "%s: can't create udev device\n", MYDEV_NAME);
+        result = -ENOMEM;
+        goto fail_device;
+    }
+
+    printk(KERN_WARNING "set up udev entry\n");
+
+    // the block device shares the page list set up above
+    if (asgn1_blk_pages > 0 && (result = asgn1_blk_setup()) < 0) {
+        goto fail_blk;
+    }
+
+    printk(KERN_WARNING "Hello world from %s\n", MYDEV_NAME);
+    return 0;
+
+    // cleanup if class init fails
+fail_class:
+    remove_proc_entry(MYDEV_NAME, NULL);
+    destroy_store(&asgn1_device.store);
+    cdev_del(asgn1_device.cdev);
+    unregister_chrdev_region(asgn1_device.dev, asgn1_dev_count);
+
+    return result;
+
+    // cleanup if device init fails
+fail_device:
+    class_destroy(asgn1_device.class);
+    goto fail_class;
+
+    // cleanup if block device init fails
+fail_blk:
+    device_destroy(asgn1_device.class, asgn1_device.dev);
+    goto fail_device;
+}
+
+/**
+ * Finalise the module
+ */
+void __exit asgn1_exit_module(void){
+    // free and destroy things set up in reverse order
+    if (asgn1_blk_pages > 0) {
+        asgn1_blk_cleanup();
+    }
+    device_destroy(asgn1_device.class, asgn1_device.dev);
+    class_destroy(asgn1_device.class);
+    remove_proc_entry(MYDEV_NAME, NULL);
+    printk(KERN_WARNING "cleaned up udev entry\n");
+
+    destroy_store(&asgn1_device.store);
+    cdev_del(asgn1_device.cdev);
+    unregister_chrdev_region(asgn1_device.dev, asgn1_dev_count);
+
+    printk(KERN_WARNING "Good bye from %s\n", MYDEV_NAME);
+}
+
+
+module_init(asgn1_init_module);
+module_exit(asgn1_exit_module);
+
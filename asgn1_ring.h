@@ -0,0 +1,254 @@
+/**
+ * File: asgn1_ring.h
+ *
+ * Layout of the shared memory ring exposed by asgn1 when it is loaded with
+ * asgn1_mode=2, plus lock-free enqueue/dequeue helpers for userspace.
+ *
+ * Mapping the device at offset 0 gives one control page followed by
+ * asgn1_ring_pages data pages. The producer only ever writes head and the
+ * consumer only ever writes tail; both are free running byte counts and
+ * live on their own cache lines. Records are a 32-bit length followed by
+ * the payload, padded to 8 bytes. A record that does not fit before the end
+ * of the ring is preceded by a pad record that skips to the start.
+ *
+ * The driver is only needed when a side runs out of work: it sets its
+ * waiting flag, rechecks the ring and then sleeps in ASGN1_RING_WAIT_DATA or
+ * ASGN1_RING_WAIT_SPACE. The other side calls ASGN1_RING_KICK if it sees
+ * the flag set after publishing.
+ *
+ * poll, select and epoll on the device report the same readiness, but a
+ * side is only kicked while its waiting flag is set. Call
+ * asgn1_ring_prepare_data (or _space) before polling and only poll if it
+ * returns 0, then call asgn1_ring_finish_data (or _space) once woken.
+ * POLLOUT only means some space is free, so a large record may still need
+ * asgn1_ring_wait_space.
+ */
+
+#ifndef ASGN1_RING_H
+#define ASGN1_RING_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define ASGN1_RING_MAGIC 0x61736731      /* "asg1" */
+#define ASGN1_RING_CACHELINE 64
+#define ASGN1_RING_PAD 0xffffffffU       /* skip to the start of the ring */
+#define ASGN1_RING_ALIGN(len) (((len) + 4 + 7) & ~7UL)
+
+#define RING_WAIT_DATA_OP 3
+#define RING_WAIT_SPACE_OP 4
+#define RING_KICK_OP 5
+#define ASGN1_RING_WAIT_DATA _IO('k', RING_WAIT_DATA_OP)
+#define ASGN1_RING_WAIT_SPACE _IOW('k', RING_WAIT_SPACE_OP, int)
+#define ASGN1_RING_KICK _IO('k', RING_KICK_OP)
+
+struct asgn1_ring_ctrl {
+    __u32 magic;
+    __u32 data_pages;     /* data pages following the control page */
+    __u64 data_size;      /* bytes in the ring, always a power of two */
+
+    /* written by the producer */
+    __u64 head __attribute__((aligned(ASGN1_RING_CACHELINE)));
+    __u32 producer_waiting;
+
+    /* written by the consumer */
+    __u64 tail __attribute__((aligned(ASGN1_RING_CACHELINE)));
+    __u32 consumer_waiting;
+};
+
+#ifndef __KERNEL__
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+struct asgn1_ring {
+    int fd;
+    struct asgn1_ring_ctrl *ctrl;
+    char *data;
+    __u64 size;
+    size_t map_len;
+};
+
+/**
+ * Maps the control page and data pages of an open asgn1 ring device.
+ * Returns 0 on success or -1 with errno set.
+ */
+static inline int asgn1_ring_map(struct asgn1_ring *ring, int fd)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    struct asgn1_ring_ctrl *ctrl;
+    __u32 data_pages;
+
+    // the control page says how big the rest of the mapping is
+    ctrl = mmap(NULL, page_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (ctrl == MAP_FAILED)
+        return -1;
+    if (ctrl->magic != ASGN1_RING_MAGIC) {
+        munmap(ctrl, page_size);
+        errno = EINVAL;
+        return -1;
+    }
+    data_pages = ctrl->data_pages;
+    munmap(ctrl, page_size);
+
+    ring->fd = fd;
+    ring->map_len = (1 + data_pages) * page_size;
+    ring->ctrl = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    if (ring->ctrl == MAP_FAILED)
+        return -1;
+    ring->data = (char *)ring->ctrl + page_size;
+    ring->size = ring->ctrl->data_size;
+    return 0;
+}
+
+static inline void asgn1_ring_unmap(struct asgn1_ring *ring)
+{
+    munmap(ring->ctrl, ring->map_len);
+}
+
+/**
+ * Copies one record into the ring. Returns 0 on success, -EAGAIN if there
+ * is not enough free space yet or -E2BIG if the record can never fit.
+ * Only one thread may enqueue at a time.
+ */
+static inline int asgn1_ring_enqueue(struct asgn1_ring *ring,
+                                     const void *rec, __u32 len)
+{
+    __u64 need = ASGN1_RING_ALIGN(len);
+    __u64 head = ring->ctrl->head;
+    __u64 tail = __atomic_load_n(&ring->ctrl->tail, __ATOMIC_ACQUIRE);
+    __u64 pos = head & (ring->size - 1);
+    __u64 skip = ring->size - pos < need ? ring->size - pos : 0;
+
+    if (need > ring->size / 2)
+        return -E2BIG;
+    if (skip + need > ring->size - (head - tail))
+        return -EAGAIN;
+
+    if (skip) {
+        *(__u32 *)(ring->data + pos) = ASGN1_RING_PAD;
+        head += skip;
+        pos = 0;
+    }
+    *(__u32 *)(ring->data + pos) = len;
+    memcpy(ring->data + pos + 4, rec, len);
+    __atomic_store_n(&ring->ctrl->head, head + need, __ATOMIC_RELEASE);
+
+    // pairs with the fence in asgn1_ring_prepare_data
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->ctrl->consumer_waiting, __ATOMIC_RELAXED))
+        ioctl(ring->fd, ASGN1_RING_KICK);
+    return 0;
+}
+
+/**
+ * Copies the oldest record out of the ring into buf. Returns the record
+ * length, -EAGAIN if the ring is empty or -E2BIG if buf is too small.
+ * Only one thread may dequeue at a time.
+ */
+static inline int asgn1_ring_dequeue(struct asgn1_ring *ring,
+                                     void *buf, __u32 buf_len)
+{
+    __u64 tail = ring->ctrl->tail;
+    __u64 head = __atomic_load_n(&ring->ctrl->head, __ATOMIC_ACQUIRE);
+    __u64 pos;
+    __u32 len;
+
+    if (head == tail)
+        return -EAGAIN;
+
+    pos = tail & (ring->size - 1);
+    len = *(__u32 *)(ring->data + pos);
+    if (len == ASGN1_RING_PAD) {
+        tail += ring->size - pos;
+        pos = 0;
+        len = *(__u32 *)(ring->data + pos);
+    }
+    if (len > buf_len)
+        return -E2BIG;
+
+    memcpy(buf, ring->data + pos + 4, len);
+    __atomic_store_n(&ring->ctrl->tail, tail + ASGN1_RING_ALIGN(len),
+                     __ATOMIC_RELEASE);
+
+    // pairs with the fence in asgn1_ring_prepare_space
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->ctrl->producer_waiting, __ATOMIC_RELAXED))
+        ioctl(ring->fd, ASGN1_RING_KICK);
+    return len;
+}
+
+/**
+ * Marks the consumer as waiting so the producer will kick it, then
+ * rechecks the ring. Returns 1 if there is already a record, otherwise 0
+ * and the caller may sleep in ASGN1_RING_WAIT_DATA or poll for POLLIN.
+ */
+static inline int asgn1_ring_prepare_data(struct asgn1_ring *ring)
+{
+    __atomic_store_n(&ring->ctrl->consumer_waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_load_n(&ring->ctrl->head, __ATOMIC_ACQUIRE) !=
+        ring->ctrl->tail;
+}
+
+static inline void asgn1_ring_finish_data(struct asgn1_ring *ring)
+{
+    __atomic_store_n(&ring->ctrl->consumer_waiting, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * Marks the producer as waiting so the consumer will kick it, then
+ * rechecks the ring. Returns 1 if a record of len bytes could already be
+ * enqueued, allowing for a pad record at the end of the ring, otherwise 0
+ * and the caller may sleep in ASGN1_RING_WAIT_SPACE or poll for POLLOUT.
+ */
+static inline int asgn1_ring_prepare_space(struct asgn1_ring *ring,
+                                           __u32 len)
+{
+    __atomic_store_n(&ring->ctrl->producer_waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return ring->size - (ring->ctrl->head -
+        __atomic_load_n(&ring->ctrl->tail, __ATOMIC_ACQUIRE)) >=
+        ASGN1_RING_ALIGN(len) * 2;
+}
+
+static inline void asgn1_ring_finish_space(struct asgn1_ring *ring)
+{
+    __atomic_store_n(&ring->ctrl->producer_waiting, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * Sleeps in the driver until the ring holds at least one record.
+ */
+static inline int asgn1_ring_wait_data(struct asgn1_ring *ring)
+{
+    int result = 0;
+
+    if (!asgn1_ring_prepare_data(ring))
+        result = ioctl(ring->fd, ASGN1_RING_WAIT_DATA);
+    asgn1_ring_finish_data(ring);
+    return result;
+}
+
+/**
+ * Sleeps in the driver until a record of len bytes could be enqueued,
+ * allowing for a pad record at the end of the ring.
+ */
+static inline int asgn1_ring_wait_space(struct asgn1_ring *ring, __u32 len)
+{
+    int need = ASGN1_RING_ALIGN(len) * 2;
+    int result = 0;
+
+    if (!asgn1_ring_prepare_space(ring, len))
+        result = ioctl(ring->fd, ASGN1_RING_WAIT_SPACE, &need);
+    asgn1_ring_finish_space(ring);
+    return result;
+}
+
+#endif /* __KERNEL__ */
+
+#endif /* ASGN1_RING_H */
@@ -0,0 +1,487 @@
+/**
+ * File: asgn1_selftest.c
+ *
+ * Self tests of the page store, run on stores of their own when the module
+ * is loaded with asgn1_selftest set, before the device is set up. They cover
+ * lookups at any page, growing, freeing, mmap range checks and seeking. A
+ * failure is logged and fails the load, so booting a kernel under qemu and
+ * loading the module is enough for a test run. With asgn1_selftest=2 lookup
+ * and copy speed are also timed at 1M, 1G and 16G, skipping any size whose
+ * nodes and written pages would take more than half of the free memory.
+ */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <asm/uaccess.h>
+
+#include "asgn1_store.h"
+#include "asgn1_selftest.h"
+
+#define TEST_PAGES 40
+#define LOOKUP_OPS 1024
+#define WALK_STEPS (1UL << 26)  /* most list steps for each list benchmark */
+#define COPY_OPS 1024
+#define COPY_SIZE (64 * 1024)
+
+static int failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printk(KERN_ERR "asgn1 selftest: %s:%d: %s failed\n", \
+                __func__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+/* for checks the rest of the test cannot go on without */
+#define REQUIRE(cond) do { \
+    if (!(cond)) { \
+        printk(KERN_ERR "asgn1 selftest: %s:%d: %s failed\n", \
+                __func__, __LINE__, #cond); \
+        failures++; \
+        return; \
+    } \
+} while (0)
+
+static unsigned long seed = 1;
+
+static unsigned long rnd(void) {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+/**
+ * Fills a store with nr_pages holes, keeping the nodes in order in nodes if
+ * it is not NULL. Returns -ENOMEM if there is not the memory for them.
+ */
+static int add_holes(asgn1_store *store, unsigned long nr_pages,
+        page_node **nodes) {
+    page_node *curr;
+    unsigned long i;
+
+    for (i = 0; i < nr_pages; i++) {
+        if ((curr = add_memory_node(store)) == NULL) {
+            return -ENOMEM;
+        }
+        if (nodes != NULL) {
+            nodes[i] = curr;
+        }
+        if (i % 4096 == 0) {
+            cond_resched();
+        }
+    }
+    store->data_size = store->num_pages * PAGE_SIZE;
+    return 0;
+}
+
+/**
+ * add_holes for a test's own store, which is destroyed if there is not the
+ * memory so the test can just give up.
+ */
+static int add_test_holes(asgn1_store *store, unsigned long nr_pages,
+        page_node **nodes) {
+    if (add_holes(store, nr_pages, nodes) < 0) {
+        printk(KERN_ERR "asgn1 selftest: not enough memory\n");
+        destroy_store(store);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+/**
+ * Every page can be found from either end of the list, from a cursor
+ * anywhere and through the index, and a cursor from before a free is not
+ * followed.
+ */
+static void test_lookup(void) {
+    page_node *nodes[TEST_PAGES];
+    asgn1_store store;
+    asgn1_cursor cursor = { NULL, 0, 0 };
+    unsigned long i, j;
+
+    REQUIRE(init_store(&store) == 0);
+    REQUIRE(add_test_holes(&store, TEST_PAGES, nodes) == 0);
+
+    for (i = 0; i < TEST_PAGES; i++) {
+        CHECK(find_page_node(&store, i, NULL) == nodes[i]);
+        for (j = 0; j < TEST_PAGES; j += 7) {
+            cursor.node = nodes[j];
+            cursor.node_no = j;
+            cursor.generation = store.generation;
+            CHECK(find_page_node(&store, i, &cursor) == nodes[i]);
+        }
+    }
+
+    // regrowing after a free gives new nodes the old cursor must not use
+    free_memory_pages(&store);
+    if (add_holes(&store, TEST_PAGES, nodes) == 0) {
+        CHECK(find_page_node(&store, TEST_PAGES / 2, &cursor) ==
+                nodes[TEST_PAGES / 2]);
+    }
+    free_memory_pages(&store);
+
+    if (fix_store_size(&store, TEST_PAGES) < 0) {
+        destroy_store(&store);
+        REQUIRE(!"not enough memory");
+    }
+    for (i = 0; i < TEST_PAGES; i++) {
+        CHECK(find_page_node(&store, i, NULL) == store.index[i]);
+        CHECK(store.index[i]->page == NULL);
+    }
+    CHECK(fix_store_size(&store, 1) == -EBUSY);
+    CHECK(store.num_pages == TEST_PAGES);
+    destroy_store(&store);
+}
+
+/**
+ * Writes grow the store a page at a time and read back the same, from any
+ * offset and across page boundaries. Writing past the end of the data
+ * writes nothing and a fixed size store will not grow.
+ */
+static void test_growth(void) {
+    asgn1_store store;
+    asgn1_cursor cursor = { NULL, 0, 0 };
+    size_t size = 3 * PAGE_SIZE + 100;
+    char *data, *buf;
+    size_t pos, len;
+    ssize_t n;
+
+    data = vmalloc(size);
+    buf = vmalloc(size);
+    if (data == NULL || buf == NULL || init_store(&store) < 0) {
+        CHECK(!"not enough memory");
+        goto out;
+    }
+    for (pos = 0; pos < size; pos++) {
+        data[pos] = rnd();
+    }
+
+    for (pos = 0; pos < size; pos += n) {
+        len = min_t(size_t, 1000, size - pos);
+        n = store_write(&store, &cursor, data + pos, len, pos, 0);
+        CHECK(n == len);
+        if (n <= 0) {
+            break;
+        }
+        CHECK(store.data_size == pos + n);
+        CHECK(store.num_pages == DIV_ROUND_UP(pos + n, PAGE_SIZE));
+    }
+
+    for (pos = 0; pos < size; pos += 777) {
+        len = min_t(size_t, 2 * PAGE_SIZE, size - pos);
+        CHECK(store_read(&store, &cursor, buf, 2 * PAGE_SIZE, pos, 0) == len);
+        CHECK(memcmp(buf, data + pos, len) == 0);
+    }
+    CHECK(store_read(&store, &cursor, buf, 1, size, 0) == 0);
+    CHECK(store_write(&store, &cursor, data, 1, size + 1, 0) == 0);
+    CHECK(store.data_size == size);
+
+    // overwriting in the middle does not grow it
+    CHECK(store_write(&store, &cursor, data, PAGE_SIZE, 10, 0) == PAGE_SIZE);
+    CHECK(store.num_pages == 4);
+    CHECK(store.data_size == size);
+    destroy_store(&store);
+
+    memset(&cursor, 0, sizeof(cursor));
+    if (init_store(&store) < 0) {
+        CHECK(!"not enough memory");
+        goto out;
+    }
+    if (fix_store_size(&store, 2) == 0) {
+        CHECK(store_write(&store, &cursor, data, PAGE_SIZE, PAGE_SIZE + 1,
+                    0) == PAGE_SIZE - 1);
+        CHECK(store_write(&store, &cursor, data, 1, 2 * PAGE_SIZE, 0) ==
+                -ENOSPC);
+        CHECK(store.num_pages == 2);
+        CHECK(store.data_size == 2 * PAGE_SIZE);
+    } else {
+        CHECK(!"not enough memory");
+    }
+    destroy_store(&store);
+
+out:
+    vfree(data);
+    vfree(buf);
+}
+
+/**
+ * Freeing empties the store, though truncating does not while it is mapped,
+ * and the fifo's freeing of the first page moves the rest of the data back
+ * a page.
+ */
+static void test_free(void) {
+    asgn1_store store;
+    asgn1_cursor cursor = { NULL, 0, 0 };
+    unsigned long generation;
+    char buf[16];
+
+    REQUIRE(init_store(&store) == 0);
+    memset(buf, 'a', sizeof(buf));
+    CHECK(store_write(&store, &cursor, buf, sizeof(buf), PAGE_SIZE - 8, 0) ==
+            0);
+    REQUIRE(add_test_holes(&store, 1, NULL) == 0);
+    CHECK(store_write(&store, &cursor, buf, sizeof(buf), PAGE_SIZE - 8, 0) ==
+            sizeof(buf));
+    CHECK(store.num_pages == 2);
+
+    generation = store.generation;
+    free_first_page(&store);
+    CHECK(store.num_pages == 1);
+    CHECK(store.data_size == 8);
+    CHECK(store.generation != generation);
+    memset(buf, 0, sizeof(buf));
+    CHECK(store_read(&store, &cursor, buf, sizeof(buf), 0, 0) == 8);
+    CHECK(buf[0] == 'a' && buf[7] == 'a' && buf[8] == 0);
+
+    store.nr_mappings = 1;
+    CHECK(truncate_store(&store) == -EBUSY);
+    CHECK(store.num_pages == 1);
+    CHECK(store.data_size == 8);
+    store.nr_mappings = 0;
+
+    generation = store.generation;
+    CHECK(truncate_store(&store) == 0);
+    CHECK(store.num_pages == 0);
+    CHECK(store.data_size == 0);
+    CHECK(store.index == NULL);
+    CHECK(store.generation != generation);
+    CHECK(list_empty(&store.mem_list));
+    CHECK(store_read(&store, &cursor, buf, sizeof(buf), 0, 0) == 0);
+    destroy_store(&store);
+}
+
+/**
+ * Mappings must be whole pages within the store, however large the offset
+ * or length asked for.
+ */
+static void test_map(void) {
+    asgn1_store store;
+
+    REQUIRE(init_store(&store) == 0);
+    REQUIRE(add_test_holes(&store, 4, NULL) == 0);
+
+    CHECK(store_check_map(&store, 0, 4 * PAGE_SIZE) == 0);
+    CHECK(store_check_map(&store, 3, PAGE_SIZE) == 0);
+    CHECK(store_check_map(&store, 4, 0) == 0);
+    CHECK(store_check_map(&store, 0, 5 * PAGE_SIZE) == -EAGAIN);
+    CHECK(store_check_map(&store, 3, 2 * PAGE_SIZE) == -EAGAIN);
+    CHECK(store_check_map(&store, 5, 0) == -EAGAIN);
+    CHECK(store_check_map(&store, 0, PAGE_SIZE + 1) == -EAGAIN);
+    CHECK(store_check_map(&store, ULONG_MAX >> PAGE_SHIFT, PAGE_SIZE) ==
+            -EAGAIN);
+    CHECK(store_check_map(&store, 1, ULONG_MAX & PAGE_MASK) == -EAGAIN);
+    destroy_store(&store);
+}
+
+/**
+ * Seeks from each whence land where they should and stay within the store.
+ */
+static void test_seek(void) {
+    asgn1_store store;
+    loff_t size;
+
+    REQUIRE(init_store(&store) == 0);
+    REQUIRE(add_test_holes(&store, 4, NULL) == 0);
+    store.data_size = 3 * PAGE_SIZE + 10;
+    size = 4 * PAGE_SIZE;
+
+    CHECK(store_seek(&store, 50, 100, SEEK_SET) == 100);
+    CHECK(store_seek(&store, 50, 100, SEEK_CUR) == 150);
+    CHECK(store_seek(&store, 50, -20, SEEK_CUR) == 30);
+    CHECK(store_seek(&store, 50, 0, SEEK_END) == 3 * PAGE_SIZE + 10);
+    CHECK(store_seek(&store, 50, -10, SEEK_END) == 3 * PAGE_SIZE);
+
+    // seeking past either end stops there
+    CHECK(store_seek(&store, 50, -100, SEEK_CUR) == 0);
+    CHECK(store_seek(&store, 50, size, SEEK_CUR) == size);
+    CHECK(store_seek(&store, 50, -1, SEEK_SET) == 0);
+    CHECK(store_seek(&store, 50, size + 1, SEEK_SET) == size);
+    CHECK(store_seek(&store, 50, LLONG_MAX, SEEK_CUR) == size);
+    CHECK(store_seek(&store, 50, LLONG_MAX, SEEK_END) == size);
+    CHECK(store_seek(&store, 50, LLONG_MIN, SEEK_CUR) == 0);
+    CHECK(store_seek(&store, 50, LLONG_MIN, SEEK_END) == 0);
+
+    CHECK(store_seek(&store, 50, 0, 3) == -EINVAL);
+    destroy_store(&store);
+}
+
+static void report(const char *test, u64 size, unsigned long ops, u64 bytes,
+        ktime_t start) {
+    u64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+    // bytes per ns times 1000 is MB/s
+    printk(KERN_INFO "asgn1 bench: %s size=%lluM ops=%lu ns_per_op=%llu "
+            "mb_per_s=%llu\n", test, size >> 20, ops,
+            div_u64(ns, ops), ns ? div64_u64(bytes * 1000, ns) : 0);
+}
+
+/**
+ * Returns whether a fixed size store of nr_pages, and the pages the
+ * benchmarks write into it, fit in half of the free memory. Node allocations
+ * are not allowed to fail, so running out would wake the OOM killer rather
+ * than failing fix_store_size.
+ */
+static int bench_fits(unsigned long nr_pages) {
+    struct sysinfo info;
+    unsigned long touched, needed;
+
+    touched = min_t(unsigned long, nr_pages,
+            LOOKUP_OPS + COPY_OPS * (COPY_SIZE / PAGE_SIZE));
+    needed = ((nr_pages * (sizeof(page_node) + sizeof(page_node *))) >>
+            PAGE_SHIFT) + touched;
+
+    si_meminfo(&info);
+    return needed <= info.freeram / 2;
+}
+
+/**
+ * Times lookups and copies on a store of size bytes of holes. Random copies
+ * only fill in the pages they touch, so even the largest store needs little
+ * more than its page nodes.
+ */
+static void bench_size(u64 size, char *buf) {
+    unsigned long nr_pages = div_u64(size, PAGE_SIZE);
+    asgn1_store store;
+    asgn1_cursor cursor = { NULL, 0, 0 };
+    page_node **index;
+    unsigned long i, page_no, ops;
+    ktime_t start;
+
+    if (size > ULONG_MAX || nr_pages > INT_MAX) {
+        printk(KERN_INFO "asgn1 bench: skipping %lluM, too large for this "
+                "machine\n", size >> 20);
+        return;
+    }
+    if (!bench_fits(nr_pages)) {
+        printk(KERN_INFO "asgn1 bench: skipping %lluM, not enough free "
+                "memory\n", size >> 20);
+        return;
+    }
+    if (init_store(&store) < 0) {
+        return;
+    }
+    if (fix_store_size(&store, nr_pages) < 0) {
+        printk(KERN_INFO "asgn1 bench: skipping %lluM, not enough memory\n",
+                size >> 20);
+        destroy_store(&store);
+        return;
+    }
+
+    // first as the character device walks the list, with fewer random
+    // lookups the longer the list so the largest sizes finish
+    index = store.index;
+    store.index = NULL;
+    ops = clamp(WALK_STEPS / nr_pages, 16UL, (unsigned long)LOOKUP_OPS);
+
+    start = ktime_get();
+    for (i = 0; i < ops; i++) {
+        find_page_node(&store, rnd() % nr_pages, NULL);
+        cond_resched();
+    }
+    report("lookup_random", size, ops, 0, start);
+
+    page_no = 0;
+    start = ktime_get();
+    for (i = 0; i < LOOKUP_OPS; i++) {
+        page_no = (page_no + rnd() % 16) % nr_pages;
+        cursor.node = find_page_node(&store, page_no, &cursor);
+        cursor.node_no = page_no;
+        cursor.generation = store.generation;
+    }
+    report("lookup_cursor", size, LOOKUP_OPS, 0, start);
+
+    start = ktime_get();
+    for (i = 0; i < ops; i++) {
+        store_write(&store, &cursor, buf, PAGE_SIZE,
+                (loff_t)(rnd() % nr_pages) * PAGE_SIZE, 0);
+        cond_resched();
+    }
+    report("rand_write", size, ops, (u64)ops * PAGE_SIZE, start);
+
+    start = ktime_get();
+    for (i = 0; i < ops; i++) {
+        store_read(&store, &cursor, buf, PAGE_SIZE,
+                (loff_t)(rnd() % nr_pages) * PAGE_SIZE, 0);
+        cond_resched();
+    }
+    report("rand_read", size, ops, (u64)ops * PAGE_SIZE, start);
+
+    // then as the block device looks pages up in the index
+    store.index = index;
+
+    start = ktime_get();
+    for (i = 0; i < LOOKUP_OPS; i++) {
+        find_page_node(&store, rnd() % nr_pages, NULL);
+    }
+    report("lookup_index", size, LOOKUP_OPS, 0, start);
+
+    start = ktime_get();
+    for (i = 0; i < COPY_OPS; i++) {
+        store_write(&store, &cursor, buf, COPY_SIZE,
+                (loff_t)(rnd() % (nr_pages - COPY_SIZE / PAGE_SIZE + 1)) *
+                PAGE_SIZE, 0);
+        cond_resched();
+    }
+    report("index_write", size, COPY_OPS, (u64)COPY_OPS * COPY_SIZE, start);
+
+    start = ktime_get();
+    for (i = 0; i < COPY_OPS; i++) {
+        store_read(&store, &cursor, buf, COPY_SIZE,
+                (loff_t)(rnd() % (nr_pages - COPY_SIZE / PAGE_SIZE + 1)) *
+                PAGE_SIZE, 0);
+        cond_resched();
+    }
+    report("index_read", size, COPY_OPS, (u64)COPY_OPS * COPY_SIZE, start);
+
+    destroy_store(&store);
+}
+
+/**
+ * Runs the self tests, then the benchmarks if bench is set. Returns -EINVAL
+ * if any test failed.
+ */
+int asgn1_selftest(int bench) {
+    static const u64 bench_sizes[] = { 1ULL << 20, 1ULL << 30, 16ULL << 30 };
+    mm_segment_t old_fs;
+    char *buf;
+    int i;
+
+    // the store copies to and from user pointers so let it use ours
+    old_fs = get_fs();
+    set_fs(KERNEL_DS);
+
+    failures = 0;
+    test_lookup();
+    test_growth();
+    test_free();
+    test_map();
+    test_seek();
+
+    if (bench && failures == 0) {
+        if ((buf = vmalloc(COPY_SIZE)) != NULL) {
+            memset(buf, 'b', COPY_SIZE);
+            for (i = 0; i < ARRAY_SIZE(bench_sizes); i++) {
+                bench_size(bench_sizes[i], buf);
+            }
+            vfree(buf);
+        }
+    }
+
+    set_fs(old_fs);
+
+    if (failures) {
+        printk(KERN_ERR "asgn1 selftest: %d checks failed\n", failures);
+        return -EINVAL;
+    }
+    printk(KERN_INFO "asgn1 selftest: all passed\n");
+    return 0;
+}
@@ -0,0 +1,12 @@
+/**
+ * File: asgn1_selftest.h
+ *
+ * Self tests and benchmarks of the page store, run when the module loads.
+ */
+
+#ifndef ASGN1_SELFTEST_H
+#define ASGN1_SELFTEST_H
+
+int asgn1_selftest(int bench);
+
+#endif /* ASGN1_SELFTEST_H */
@@ -0,0 +1,280 @@
+/**
+ * File: asgn1_shim.h
+ *
+ * The little of the kernel that the page store in asgn1_store.c uses. In
+ * the module this is just the kernel headers; built in userspace it is a
+ * stand in good enough to test and benchmark the store without root or an
+ * insmod. User pointers are plain pointers there and copies never fault.
+ * The nocache copy and eviction are real where the cpu has SSE2, which
+ * SHIM_NOCACHE says, and plain copies and no-ops elsewhere.
+ */
+
+#ifndef ASGN1_SHIM_H
+#define ASGN1_SHIM_H
+
+#ifdef __KERNEL__
+
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/list.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/highmem.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <asm/uaccess.h>
+#ifdef CONFIG_X86
+#include <asm/processor.h>
+#include <asm/cpufeature.h>
+#endif
+
+/**
+ * Evicts a range of the store from the cpu cache once it has been copied
+ * out, so a streaming read leaves the reader's working set alone. Only does
+ * anything where the cpu can flush lines without invalidating the page.
+ */
+static inline void evict_page_range(void *addr, size_t len) {
+#ifdef CONFIG_X86
+    unsigned long line = boot_cpu_data.x86_clflush_size;
+    char *p;
+
+    if (!cpu_has_clflush) {
+        return;
+    }
+    mb();
+    for (p = (char *)((unsigned long)addr & ~(line - 1));
+            p < (char *)addr + len; p += line) {
+        clflush(p);
+    }
+    mb();
+#endif
+}
+
+#else /* !__KERNEL__ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#define __user
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+#define printk(...) ((void)0)
+#define KERN_ERR
+#define KERN_WARNING
+#define KERN_INFO
+
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1UL << PAGE_SHIFT)
+#define PAGE_MASK (~(PAGE_SIZE - 1))
+
+#define min_t(type, x, y) ((type)(x) < (type)(y) ? (type)(x) : (type)(y))
+
+typedef unsigned long long u64;
+typedef unsigned int gfp_t;
+
+#define GFP_KERNEL 0x1U
+#define GFP_NOIO 0x2U
+#define __GFP_ZERO 0x100U
+
+/* lists, as in linux/list.h */
+struct list_head {
+    struct list_head *next, *prev;
+};
+
+static inline void INIT_LIST_HEAD(struct list_head *list) {
+    list->next = list;
+    list->prev = list;
+}
+
+static inline void list_add_tail(struct list_head *entry,
+        struct list_head *head) {
+    entry->prev = head->prev;
+    entry->next = head;
+    head->prev->next = entry;
+    head->prev = entry;
+}
+
+static inline void list_del(struct list_head *entry) {
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    entry->next = entry->prev = NULL;
+}
+
+static inline void list_del_init(struct list_head *entry) {
+    list_del(entry);
+    INIT_LIST_HEAD(entry);
+}
+
+#define list_entry(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define list_for_each_entry(pos, head, member) \
+    for (pos = list_entry((head)->next, __typeof__(*pos), member); \
+         &pos->member != (head); \
+         pos = list_entry(pos->member.next, __typeof__(*pos), member))
+
+#define list_for_each_entry_safe(pos, n, head, member) \
+    for (pos = list_entry((head)->next, __typeof__(*pos), member), \
+         n = list_entry(pos->member.next, __typeof__(*pos), member); \
+         &pos->member != (head); \
+         pos = n, n = list_entry(n->member.next, __typeof__(*n), member))
+
+/* spinlocks are mutexes so the sanitizers can see them */
+typedef pthread_mutex_t spinlock_t;
+#define spin_lock_init(lock) pthread_mutex_init(lock, NULL)
+#define spin_lock(lock) pthread_mutex_lock(lock)
+#define spin_unlock(lock) pthread_mutex_unlock(lock)
+
+/* pages are reference counted page sized allocations */
+struct page {
+    int count;
+    void *addr;
+};
+
+static inline struct page *alloc_page(gfp_t gfp) {
+    struct page *page = malloc(sizeof(struct page));
+
+    if (page == NULL) {
+        return NULL;
+    }
+    if ((page->addr = aligned_alloc(PAGE_SIZE, PAGE_SIZE)) == NULL) {
+        free(page);
+        return NULL;
+    }
+    if (gfp & __GFP_ZERO) {
+        memset(page->addr, 0, PAGE_SIZE);
+    }
+    page->count = 1;
+    return page;
+}
+
+static inline void get_page(struct page *page) {
+    __atomic_add_fetch(&page->count, 1, __ATOMIC_RELAXED);
+}
+
+static inline void put_page(struct page *page) {
+    if (__atomic_sub_fetch(&page->count, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(page->addr);
+        free(page);
+    }
+}
+
+#define __free_page(page) put_page(page)
+#define page_count(page) __atomic_load_n(&(page)->count, __ATOMIC_ACQUIRE)
+#define page_address(page) ((page)->addr)
+#define clear_page(addr) memset(addr, 0, PAGE_SIZE)
+
+static inline void *memchr_inv(const void *start, int c, size_t bytes) {
+    const unsigned char *p = start;
+
+    for (; bytes > 0; p++, bytes--) {
+        if (*p != (unsigned char)c) {
+            return (void *)p;
+        }
+    }
+    return NULL;
+}
+
+/* slab caches and vmalloc are plain malloc */
+struct kmem_cache {
+    size_t size;
+};
+
+static inline struct kmem_cache *kmem_cache_create(const char *name,
+        size_t size, size_t align, unsigned long flags, void *ctor) {
+    struct kmem_cache *cache = malloc(sizeof(struct kmem_cache));
+
+    (void)name; (void)align; (void)flags; (void)ctor;
+    if (cache != NULL) {
+        cache->size = size;
+    }
+    return cache;
+}
+
+#define kmem_cache_alloc(cache, gfp) malloc((cache)->size)
+#define kmem_cache_free(cache, obj) free(obj)
+#define kmem_cache_destroy(cache) free(cache)
+#define vmalloc(size) malloc(size)
+#define vfree(addr) free(addr)
+
+/* user copies cannot fault so they always copy everything */
+static inline unsigned long copy_to_user(void *to, const void *from,
+        unsigned long n) {
+    memcpy(to, from, n);
+    return 0;
+}
+
+static inline unsigned long copy_from_user(void *to, const void *from,
+        unsigned long n) {
+    memcpy(to, from, n);
+    return 0;
+}
+
+static inline unsigned long clear_user(void *to, unsigned long n) {
+    memset(to, 0, n);
+    return 0;
+}
+
+#define access_ok(type, addr, size) 1
+#define VERIFY_READ 0
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+#define SHIM_NOCACHE 1
+
+/* stores that go around the cache, like the kernel's movnti copy */
+static inline unsigned long __copy_from_user_nocache(void *to,
+        const void *from, unsigned long n) {
+    unsigned long head = -(unsigned long)to & 15;
+    char *d = to;
+    const char *s = from;
+
+    if (head > n) {
+        head = n;
+    }
+    memcpy(d, s, head);
+    for (d += head, s += head, n -= head; n >= 16; n -= 16) {
+        _mm_stream_si128((__m128i *)d, _mm_loadu_si128((const __m128i *)s));
+        d += 16;
+        s += 16;
+    }
+    memcpy(d, s, n);
+    _mm_sfence();
+    return 0;
+}
+
+static inline void evict_page_range(void *addr, size_t len) {
+    char *p;
+
+    _mm_mfence();
+    for (p = (char *)((unsigned long)addr & ~63UL);
+            p < (char *)addr + len; p += 64) {
+        _mm_clflush(p);
+    }
+    _mm_mfence();
+}
+
+#else /* !__SSE2__ */
+
+#define SHIM_NOCACHE 0
+#define __copy_from_user_nocache copy_from_user
+
+static inline void evict_page_range(void *addr, size_t len) {
+    (void)addr;
+    (void)len;
+}
+
+#endif /* __SSE2__ */
+
+#endif /* __KERNEL__ */
+
+#endif /* ASGN1_SHIM_H */
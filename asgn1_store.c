@@ -0,0 +1,525 @@
+/**
+ * File: asgn1_store.c
+ *
+ * The page store behind the asgn1 device. The data lives in a list of pages
+ * which grows at the end as it is written. Once something like the block
+ * device needs the size to stay put it is fixed and indexed, after which
+ * pages come and go behind their nodes as holes are filled and discarded.
+ *
+ * This file is built into the module and, through asgn1_shim.h, into a
+ * userspace library used by store_test and store_bench.
+ */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include "asgn1_store.h"
+
+/**
+ * This function sets up an empty store. Returns -ENOMEM if the page node
+ * cache cannot be created.
+ */
+int init_store(asgn1_store *store) {
+    INIT_LIST_HEAD(&(store->mem_list));
+    spin_lock_init(&store->page_lock);
+    store->num_pages = 0;
+    store->generation = 0;
+    store->data_size = 0;
+    store->nr_mappings = 0;
+    store->index = NULL;
+
+    // setup kmem cache
+    store->cache = kmem_cache_create("asgn1_cache", sizeof(page_node), 0, 0,
+            NULL);
+    if (store->cache == NULL) {
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+/**
+ * This function frees everything the store holds.
+ */
+void destroy_store(asgn1_store *store) {
+    free_memory_pages(store);
+    kmem_cache_destroy(store->cache);
+}
+
+/**
+ * This function grows an empty store to nr_pages holes and indexes them,
+ * after which the number of pages must not change until the store is freed.
+ * Returns -EBUSY if the store is not empty, as the index would not line up
+ * with the pages already there.
+ */
+int fix_store_size(asgn1_store *store, unsigned long nr_pages) {
+    unsigned long i;
+
+    if (store->num_pages != 0) {
+        return -EBUSY;
+    }
+    if ((store->index = vmalloc(nr_pages * sizeof(page_node *))) == NULL) {
+        return -ENOMEM;
+    }
+    for (i = 0; i < nr_pages; i++) {
+        if ((store->index[i] = add_memory_node(store)) == NULL) {
+            free_memory_pages(store);
+            return -ENOMEM;
+        }
+    }
+    store->data_size = store->num_pages * PAGE_SIZE;
+    return 0;
+}
+
+/**
+ * This function adds a hole to the end of the page list. Returns NULL if
+ * there is not enough memory.
+ */
+page_node *add_memory_node(asgn1_store *store) {
+    page_node *curr;
+
+    if ((curr = kmem_cache_alloc(store->cache, GFP_KERNEL)) == NULL) {
+        return NULL;
+    }
+
+    curr->page = NULL;
+    INIT_LIST_HEAD(&(curr->list));
+    list_add_tail(&(curr->list), &(store->mem_list));
+    store->num_pages++;
+    return curr;
+}
+
+/**
+ * This function allocates a new memory page and adds it to the end of the
+ * page list. Returns NULL if there is not enough memory.
+ */
+page_node *add_memory_page(asgn1_store *store) {
+    page_node *curr;
+
+    if ((curr = add_memory_node(store)) == NULL) {
+        return NULL;
+    }
+
+    if ((curr->page = alloc_page(GFP_KERNEL)) == NULL) {
+        list_del(&(curr->list));
+        kmem_cache_free(store->cache, curr);
+        store->num_pages--;
+        return NULL;
+    }
+    return curr;
+}
+
+/**
+ * This function frees the first page of the list, moving all the data back
+ * by a page. Used by the fifo once a page has been read in full.
+ */
+void free_first_page(asgn1_store *store) {
+    page_node *curr = list_entry(store->mem_list.next, page_node, list);
+
+    list_del(&(curr->list));
+    if (curr->page != NULL) {
+        __free_page(curr->page);
+    }
+    kmem_cache_free(store->cache, curr);
+    store->num_pages--;
+    store->data_size -= PAGE_SIZE;
+    store->generation++;
+}
+
+/**
+ * This function frees all memory pages held by the store.
+ */
+void free_memory_pages(asgn1_store *store) {
+    page_node *curr;
+    page_node *temp;
+
+    // free all the pages then delete page_nodes
+    list_for_each_entry_safe(curr, temp, &(store->mem_list), list) {
+        if (curr->page != NULL) {
+            __free_page(curr->page);
+        }
+        list_del(&(curr->list));
+        kmem_cache_free(store->cache, curr);
+    }
+
+    if (store->index != NULL) {
+        vfree(store->index);
+        store->index = NULL;
+    }
+    store->num_pages = 0;
+    store->data_size = 0;
+    store->generation++;
+}
+
+/**
+ * This function empties the store as free_memory_pages does, unless it is
+ * mapped. Pages already inserted into a mapping stay reachable through the
+ * page tables, so nothing is freed and -EBUSY is returned until the last
+ * mapping goes.
+ */
+int truncate_store(asgn1_store *store) {
+    int mapped;
+
+    spin_lock(&store->page_lock);
+    mapped = store->nr_mappings != 0;
+    spin_unlock(&store->page_lock);
+
+    if (mapped) {
+        return -EBUSY;
+    }
+    free_memory_pages(store);
+    return 0;
+}
+
+/**
+ * This function finds the node of the page with the given number, which
+ * must be less than num_pages. The index is used when the size is fixed,
+ * otherwise the page list is walked from whichever of its ends or the
+ * cursor (which may be NULL) is closest, so sequential access does not walk
+ * the list every call. The cursor is ignored if page nodes have been freed
+ * since it was set.
+ */
+page_node *find_page_node(asgn1_store *store, unsigned long index,
+        asgn1_cursor *cursor) {
+    unsigned long last_no = store->num_pages - 1;
+    struct list_head *ptr;
+    unsigned long curr_no;
+
+    if (store->index != NULL) {
+        return store->index[index];
+    }
+
+    // start from the nearest known position
+    if (index <= last_no - index) {
+        ptr = store->mem_list.next;
+        curr_no = 0;
+    } else {
+        ptr = store->mem_list.prev;
+        curr_no = last_no;
+    }
+    if (cursor != NULL && cursor->node != NULL &&
+            cursor->generation == store->generation &&
+            (cursor->node_no > index ? cursor->node_no - index :
+             index - cursor->node_no) < (curr_no > index ? curr_no - index :
+             index - curr_no)) {
+        ptr = &(cursor->node->list);
+        curr_no = cursor->node_no;
+    }
+
+    for (; curr_no < index; curr_no++) {
+        ptr = ptr->next;
+    }
+    for (; curr_no > index; curr_no--) {
+        ptr = ptr->prev;
+    }
+    return list_entry(ptr, page_node, list);
+}
+
+/**
+ * This function remembers the last page node a read or write touched.
+ */
+static void set_cursor(asgn1_store *store, asgn1_cursor *cursor,
+        page_node *node, unsigned long index) {
+    cursor->node = node;
+    cursor->node_no = index;
+    cursor->generation = store->generation;
+}
+
+/**
+ * This function returns the page behind a node with a reference held so a
+ * discard cannot free it while it is being copied. If the node is a hole a
+ * zeroed page is put there first when create is set, otherwise NULL is
+ * returned. Also returns NULL if there is not enough memory.
+ */
+struct page *get_node_page(asgn1_store *store, page_node *node, int create,
+        gfp_t gfp) {
+    struct page *page;
+    struct page *new_page;
+
+    spin_lock(&store->page_lock);
+    if ((page = node->page) != NULL) {
+        get_page(page);
+    }
+    spin_unlock(&store->page_lock);
+
+    if (page != NULL || !create) {
+        return page;
+    }
+
+    if ((new_page = alloc_page(gfp | __GFP_ZERO)) == NULL) {
+        return NULL;
+    }
+
+    // someone else may have filled the hole while we were allocating
+    spin_lock(&store->page_lock);
+    if (node->page == NULL) {
+        node->page = new_page;
+        new_page = NULL;
+    }
+    page = node->page;
+    get_page(page);
+    spin_unlock(&store->page_lock);
+
+    if (new_page != NULL) {
+        __free_page(new_page);
+    }
+    return page;
+}
+
+/**
+ * This function gives the page behind a node back to the allocator, leaving
+ * a hole. If the store is mapped the page may be in use by userspace so it
+ * is only zeroed.
+ */
+void discard_node_page(asgn1_store *store, page_node *node) {
+    struct page *page;
+
+    spin_lock(&store->page_lock);
+    page = node->page;
+    if (store->nr_mappings == 0) {
+        node->page = NULL;
+    } else if (page != NULL) {
+        get_page(page);
+        clear_page(page_address(page));
+    }
+    spin_unlock(&store->page_lock);
+
+    if (page != NULL) {
+        put_page(page);
+    }
+}
+
+/**
+ * This function turns a page holding nothing but zeroes back into a hole.
+ * Pages that are mapped or being copied to or from are left alone, as is
+ * anything with data in it.
+ */
+void discard_zero_page(asgn1_store *store, page_node *node) {
+    struct page *page;
+
+    spin_lock(&store->page_lock);
+    page = node->page;
+    if (page != NULL && store->nr_mappings == 0 &&
+            page_count(page) == 1 &&
+            memchr_inv(page_address(page), 0, PAGE_SIZE) == NULL) {
+        node->page = NULL;
+    } else {
+        page = NULL;
+    }
+    spin_unlock(&store->page_lock);
+
+    if (page != NULL) {
+        __free_page(page);
+    }
+}
+
+/**
+ * This function reads up to count bytes from pos in the store to the user.
+ * Returns the size read, 0 at the end of the store or -EFAULT if nothing
+ * could be copied.
+ */
+ssize_t store_read(asgn1_store *store, asgn1_cursor *cursor,
+        char __user *buf, size_t count, loff_t pos, int nocache) {
+    size_t size_read = 0;     /* size read from the store in this function */
+    size_t begin_offset;      /* the offset from the beginning of a page to
+                                 start reading */
+    unsigned long curr_page_no = pos / PAGE_SIZE;  /* the current page number */
+    size_t size_to_be_read;   /* size to be read from the current page */
+    size_t not_copied;        /* size copy_to_user could not read */
+    page_node *curr;
+    struct page *page;
+
+    if ((size_t)pos >= store->data_size || count == 0) {
+        return 0;
+    }
+    count = min_t(size_t, count, store->data_size - pos);
+
+    begin_offset = pos % PAGE_SIZE;
+    curr = find_page_node(store, curr_page_no, cursor);
+    for (;;) {
+        size_to_be_read = min_t(size_t, PAGE_SIZE - begin_offset,
+                count - size_read);
+
+        // holes read back as zeroes
+        if ((page = get_node_page(store, curr, 0, GFP_KERNEL)) != NULL) {
+            not_copied = copy_to_user(buf + size_read,
+                    page_address(page) + begin_offset, size_to_be_read);
+            if (nocache) {
+                evict_page_range(page_address(page) + begin_offset,
+                        size_to_be_read);
+            }
+            put_page(page);
+        } else {
+            not_copied = clear_user(buf + size_read, size_to_be_read);
+        }
+        size_read += size_to_be_read - not_copied;
+        set_cursor(store, cursor, curr, curr_page_no);
+        if (not_copied || size_read == count) {
+            break;
+        }
+
+        // count stops short of data_size so there is always a next page
+        begin_offset = 0;
+        curr_page_no++;
+        curr = list_entry(curr->list.next, page_node, list);
+    }
+
+    if (size_read == 0) {
+        return -EFAULT;
+    }
+    return size_read;
+}
+
+/**
+ * This function writes count bytes from the user to pos in the store,
+ * growing it unless its size is fixed. Returns the size written or an error
+ * if nothing could be written. Writing past the end of the data writes
+ * nothing.
+ */
+ssize_t store_write(asgn1_store *store, asgn1_cursor *cursor,
+        const char __user *buf, size_t count, loff_t pos, int nocache) {
+    size_t size_written = 0;  /* size written to the store in this function */
+    size_t begin_offset;      /* the offset from the beginning of a page to
+                                 start writing */
+    unsigned long curr_page_no = pos / PAGE_SIZE;  /* the current page number */
+    size_t size_to_be_written;  /* size to be written to the current page */
+    size_t not_copied;        /* size copy_from_user could not write */
+    ssize_t result = -EFAULT; /* what to return if nothing was written */
+    page_node *curr = NULL;
+    struct page *page;
+
+    // check they didnt tell me to start where i dont have
+    if ((size_t)pos > store->data_size) {
+        printk(KERN_WARNING "Reached end of the device on a write");
+        return 0;
+    }
+
+    // the nocache copy leaves checking the user buffer to us
+    if (nocache && !access_ok(VERIFY_READ, buf, count)) {
+        return -EFAULT;
+    }
+
+    begin_offset = pos % PAGE_SIZE;
+
+    while (count > size_written) {
+
+        if (curr_page_no >= (unsigned long)store->num_pages) {
+            // a fixed size store needs the number of pages to stay put
+            if (store->index != NULL) {
+                result = -ENOSPC;
+                break;
+            }
+
+            // ive run out of pages so better get a new one!
+            if ((curr = add_memory_page(store)) == NULL) {
+                printk(KERN_ERR "Not enough memory left\n");
+                result = -ENOMEM;
+                break;
+            }
+        } else if (curr == NULL) {
+            curr = find_page_node(store, curr_page_no, cursor);
+        } else {
+            curr = list_entry(curr->list.next, page_node, list);
+        }
+
+        // write to the page, filling it in first if it is a hole
+        size_to_be_written = min_t(size_t, PAGE_SIZE - begin_offset,
+                count - size_written);
+        if ((page = get_node_page(store, curr, 1, GFP_KERNEL)) == NULL) {
+            printk(KERN_ERR "Not enough memory left\n");
+            result = -ENOMEM;
+            break;
+        }
+        if (nocache) {
+            not_copied = __copy_from_user_nocache(page_address(page)
+                    + begin_offset, buf + size_written, size_to_be_written);
+        } else {
+            not_copied = copy_from_user(page_address(page) + begin_offset,
+                    buf + size_written, size_to_be_written);
+        }
+        put_page(page);
+        size_written += size_to_be_written - not_copied;
+        set_cursor(store, cursor, curr, curr_page_no);
+        if (not_copied) {
+            break;
+        }
+
+        // finished writing so now move on to the next page
+        begin_offset = 0;
+        curr_page_no++;
+    }
+
+    if (size_written == 0 && count > 0) {
+        return result;
+    }
+
+    // only store a new size so writers inside a fixed store never race on it
+    if ((size_t)pos + size_written > store->data_size) {
+        store->data_size = pos + size_written;
+    }
+    return size_written;
+}
+
+/**
+ * This function works out where a seek from pos by offset lands, measuring
+ * SEEK_END from the end of the data. The result is kept within the pages
+ * the store holds. Returns -EINVAL for any other cmd.
+ */
+loff_t store_seek(asgn1_store *store, loff_t pos, loff_t offset, int cmd) {
+    loff_t buffer_size = (loff_t)store->num_pages * PAGE_SIZE;
+    loff_t base;
+    loff_t testpos;
+
+    // depending on where im to seek from start there
+    switch (cmd) {
+        case SEEK_SET:
+            base = 0;
+            break;
+        case SEEK_CUR:
+            base = pos;
+            break;
+        case SEEK_END:
+            base = store->data_size;
+            break;
+        default:
+            return -EINVAL;
+    }
+
+    // base is never negative so only a large offset can overflow
+    if (offset > LLONG_MAX - base) {
+        testpos = buffer_size;
+    } else {
+        testpos = base + offset;
+    }
+
+    if (testpos > buffer_size) {
+        testpos = buffer_size;
+    } else if (testpos < 0) {
+        testpos = 0;
+    }
+    return testpos;
+}
+
+/**
+ * This function checks a mapping of len bytes from page pgoff lies within
+ * the store. Returns -EAGAIN if it does not.
+ */
+int store_check_map(asgn1_store *store, unsigned long pgoff,
+        unsigned long len) {
+    unsigned long nr_pages = store->num_pages;
+
+    // work in pages so a huge offset or length cannot wrap around
+    if (pgoff > nr_pages) {
+        printk(KERN_ERR "Offset must be on valid page boundary.\n");
+        return -EAGAIN;
+    } else if (len % PAGE_SIZE != 0) {
+        printk(KERN_ERR "Length must be on a multiple of page_size.\n");
+        return -EAGAIN;
+    } else if (len / PAGE_SIZE > nr_pages - pgoff) {
+        printk(KERN_ERR "You are trying to write past the ramdisk\n");
+        return -EAGAIN;
+    }
+    return 0;
+}
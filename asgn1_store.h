@@ -0,0 +1,72 @@
+/**
+ * File: asgn1_store.h
+ *
+ * The page store behind the asgn1 device: a list of pages holding the data,
+ * lookups into it, the copy loops for reading and writing it, seeking and
+ * mapping checks and freeing it. asgn1_store.c builds both into the module
+ * and, through asgn1_shim.h, as a userspace library for testing and
+ * benchmarking.
+ */
+
+#ifndef ASGN1_STORE_H
+#define ASGN1_STORE_H
+
+#include "asgn1_shim.h"
+
+/**
+ * The node structure for the memory page linked list. A NULL page is a hole
+ * left by a discard which reads back as zeroes.
+ */
+typedef struct page_node_rec {
+    struct list_head list;
+    struct page *page;
+} page_node;
+
+typedef struct asgn1_store_t {
+    struct list_head mem_list;
+    int num_pages;        /* number of memory pages this store currently holds */
+    unsigned long generation;  /* bumped whenever page nodes are freed */
+    size_t data_size;     /* total data size in this store */
+    struct kmem_cache *cache;      /* cache memory */
+    spinlock_t page_lock;    /* protects page pointers and nr_mappings */
+    int nr_mappings;         /* number of vmas mapping the store */
+    page_node **index;       /* page nodes by number once the size is fixed */
+} asgn1_store;
+
+/**
+ * The last page node a reader or writer touched, so the next call can start
+ * looking from there.
+ */
+typedef struct asgn1_cursor_t {
+    page_node *node;
+    unsigned long node_no;    /* the page number of node */
+    unsigned long generation; /* store generation node was taken in */
+} asgn1_cursor;
+
+int init_store(asgn1_store *store);
+void destroy_store(asgn1_store *store);
+int fix_store_size(asgn1_store *store, unsigned long nr_pages);
+
+page_node *add_memory_node(asgn1_store *store);
+page_node *add_memory_page(asgn1_store *store);
+void free_first_page(asgn1_store *store);
+void free_memory_pages(asgn1_store *store);
+int truncate_store(asgn1_store *store);
+
+page_node *find_page_node(asgn1_store *store, unsigned long index,
+        asgn1_cursor *cursor);
+struct page *get_node_page(asgn1_store *store, page_node *node, int create,
+        gfp_t gfp);
+void discard_node_page(asgn1_store *store, page_node *node);
+void discard_zero_page(asgn1_store *store, page_node *node);
+
+ssize_t store_read(asgn1_store *store, asgn1_cursor *cursor,
+        char __user *buf, size_t count, loff_t pos, int nocache);
+ssize_t store_write(asgn1_store *store, asgn1_cursor *cursor,
+        const char __user *buf, size_t count, loff_t pos, int nocache);
+
+loff_t store_seek(asgn1_store *store, loff_t pos, loff_t offset, int cmd);
+int store_check_map(asgn1_store *store, unsigned long pgoff,
+        unsigned long len);
+
+#endif /* ASGN1_STORE_H */
@@ -0,0 +1,70 @@
+/**
+ * File: bench_common.h
+ *
+ * Timing, error and option helpers shared by asgn1_bench and store_bench,
+ * so both parse sizes and measure time the same way.
+ */
+
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#define MAX_SIZES 16
+
+static inline uint64_t now_ns (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void die (const char *what)
+{
+    fprintf (stderr, "%s failed:  %s\n", what, strerror (errno));
+    exit (1);
+}
+
+/**
+ * Parses a size such as 4096, 64K, 16M or 1G.
+ */
+static inline unsigned long parse_size (const char *str)
+{
+    char *end;
+    unsigned long size = strtoul (str, &end, 0);
+
+    switch (*end) {
+        case 'k': case 'K': size <<= 10; break;
+        case 'm': case 'M': size <<= 20; break;
+        case 'g': case 'G': size <<= 30; break;
+        case '\0': break;
+        default:
+            fprintf (stderr, "bad size %s\n", str);
+            exit (1);
+    }
+    return size;
+}
+
+/**
+ * Parses a comma separated list of sizes into sizes, which holds MAX_SIZES,
+ * and returns how many there were.
+ */
+static inline int parse_size_list (char *str, unsigned long *sizes)
+{
+    char *tok;
+    int n = 0;
+
+    for (tok = strtok (str, ","); tok && n < MAX_SIZES;
+         tok = strtok (NULL, ",")) {
+        sizes[n++] = parse_size (tok);
+    }
+    return n;
+}
+
+#endif /* BENCH_COMMON_H */
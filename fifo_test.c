@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+
+/* load the module with asgn1_mode=1 before running this test */
+#define MYIOC_TYPE 'k'
+#define SET_NPROC_OP 1
+#define SET_FIFO_MAX_OP 2
+#define ASGN1_SET_NPROC _IOW(MYIOC_TYPE, SET_NPROC_OP, int)
+#define ASGN1_SET_FIFO_MAX _IOW(MYIOC_TYPE, SET_FIFO_MAX_OP, int)
+
+#define SIZE 1024 * 1024   /* total bytes pushed through the fifo */
+#define CHUNK 1000         /* not a multiple of the page size on purpose */
+#define FIFO_MAX_PAGES 4
+
+/* byte expected at position i of the stream */
+#define PATTERN(i) ((char)((i) * 7 + ((i) >> 12)))
+
+void producer (char *filename)
+{
+    static char buf[CHUNK];
+    unsigned long i, done = 0;
+    ssize_t written;
+    int fd;
+
+    if ((fd = open (filename, O_WRONLY)) < 0) {
+        fprintf (stderr, "producer open of %s failed:  %s\n", filename,
+                 strerror (errno));
+        exit (1);
+    }
+
+    while (done < SIZE) {
+        size_t len = SIZE - done < CHUNK ? SIZE - done : CHUNK;
+
+        for (i = 0; i < len; i++) {
+            buf[i] = PATTERN(done + i);
+        }
+
+        /* the write blocks at the high watermark, short writes are fine */
+        for (i = 0; i < len; i += written) {
+            written = write (fd, buf + i, len - i);
+            if (written < 0) {
+                if (EINTR == errno)
+                    written = 0;
+                else {
+                    perror ("write()");
+                    exit (1);
+                }
+            }
+        }
+        done += len;
+    }
+    close (fd);
+    exit (0);
+}
+
+int main (int argc, char **argv)
+{
+    static char buf[CHUNK * 3];
+    unsigned long i, done = 0, wakeups = 0;
+    int fd, status;
+    int nproc = 2, fifo_max = FIFO_MAX_PAGES;
+    char *filename = "/dev/asgn1";
+    struct pollfd pfd;
+    ssize_t got;
+    pid_t pid;
+
+    if (argc > 1)
+        filename = argv[1];
+
+    if ((fd = open (filename, O_RDONLY | O_NONBLOCK)) < 0) {
+        fprintf (stderr, "open of %s failed:  %s\n", filename,
+                 strerror (errno));
+        exit (1);
+    }
+
+    if (ioctl (fd, ASGN1_SET_NPROC, &nproc) < 0 ||
+        ioctl (fd, ASGN1_SET_FIFO_MAX, &fifo_max) < 0) {
+        fprintf (stderr, "ioctl failed:  %s\n", strerror (errno));
+        exit (1);
+    }
+
+    /* nothing written yet so a non-blocking read must not spin */
+    if (read (fd, buf, sizeof(buf)) != -1 || errno != EAGAIN) {
+        fprintf (stderr, "empty fifo read did not return EAGAIN\n");
+        exit (1);
+    }
+
+    if ((pid = fork ()) == 0)
+        producer (filename);
+    assert(pid > 0);
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (done < SIZE) {
+        if (poll (&pfd, 1, 5000) <= 0) {
+            fprintf (stderr, "poll timed out or failed at byte %lu\n", done);
+            exit (1);
+        }
+        wakeups++;
+
+        got = read (fd, buf, sizeof(buf));
+        if (got < 0) {
+            if (EAGAIN == errno || EINTR == errno)
+                continue;
+            perror ("read()");
+            exit (1);
+        }
+
+        for (i = 0; i < (unsigned long)got; i++) {
+            if (buf[i] != PATTERN(done + i)) {
+                fprintf (stderr, "stream miscompare at byte %lu\n", done + i);
+                exit (1);
+            }
+        }
+        done += got;
+    }
+
+    waitpid (pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf (stderr, "producer failed\n");
+        exit (1);
+    }
+    printf ("streamed %d bytes through the fifo in %lu poll wakeups\n",
+            SIZE, wakeups);
+    return 0;
+}
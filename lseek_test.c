@@ -70,7 +70,7 @@ void read_and_compare (int fd, char *read_buf, char *mmap_buf,
 {
     /* Read the file and compare with mmap_buf[] */
 
-    if (my_fread (fd, read_buf, len) != len) {
+    if (my_fread (fd, read_buf, len) != (ssize_t)len) {
         fprintf (stderr, "read problem:  %s\n", strerror (errno));
         exit (1);
     }
@@ -84,9 +84,9 @@ void read_and_compare (int fd, char *read_buf, char *mmap_buf,
 
 int main (int argc, char **argv)
 {
-    unsigned long i, j;
+    unsigned long i;
     int fd;
-    char *buf, *read_buf, *mmap_buf, *filename = "ramdisk";
+    char *buf, *read_buf, *filename = "ramdisk";
     int nproc = 12345;
 
     srandom (getpid ());
@@ -100,7 +100,10 @@ int main (int argc, char **argv)
         exit (1);
     }
 
-    assert(buf = malloc(SIZE));
+    if ((buf = malloc (SIZE)) == NULL || (read_buf = malloc (SIZE)) == NULL) {
+        fprintf (stderr, "malloc failed\n");
+        exit (1);
+    }
 
     for (i = 0; i < SIZE; i++) {
         buf[i] = random() % 256;
@@ -120,36 +123,10 @@ int main (int argc, char **argv)
     printf ("driver's ioctl says buffer size is %ld\n", len);
 #endif
 
-    assert(read_buf = malloc(SIZE));
-#if 0
-    mmap_buf = mmap (NULL, SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (mmap_buf == (char *)MAP_FAILED) {
-        fprintf (stderr, "mmap of %s failed:  %s\n", filename,
-                 strerror (errno));
-        exit (1);
-    }
-    printf ("mmap succeeded:  %p\n", mmap_buf);
-#endif
     (void)lseek (fd, 0, SEEK_SET);
     read_and_compare (fd, read_buf, buf, SIZE);
     printf ("lseek SEEK_SET and comparison of same data via read() and mmap() successful\n");
 
-#if 0
-    /* Change one randomly chosen byte in the mmap region */
-
-    j = random () % SIZE;
-    *(mmap_buf + j) = random () % j;
-    printf ("modified mmap_buf\n");
-
-    /*  repeat the read-back comparison. */
-    (void)lseek (fd, 0, SEEK_SET);
-    read_and_compare (fd, read_buf, buf, SIZE);
-    printf ("lseek SEEK_SET and comparison of modified data via read() and write() successful\n");
-
-
-    (void)lseek (fd, 0, SEEK_SET);
-#endif
-
     if (ioctl (fd, ASGN1_SET_NPROC, &nproc) < 0) {
         fprintf (stderr, "ioctl failed:  %s\n", strerror (errno));
         exit (1);
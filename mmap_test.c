@@ -8,6 +8,9 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <malloc.h>
+#include <limits.h>
+
+#include "asgn1_fadvise.h"
 
 //#define MMAP_DEV_CMD_GET_BUFSIZE 1  /* defines our IOCTL cmd */
 #define MYIOC_TYPE 'k'
@@ -67,7 +70,7 @@ void read_and_compare (int fd, char *read_buf, char *mmap_buf,
 {
     /* Read the file and compare with mmap_buf[] */
 
-    if (my_fread (fd, read_buf, len) != len) {
+    if (my_fread (fd, read_buf, len) != (ssize_t)len) {
         fprintf (stderr, "read problem:  %s\n", strerror (errno));
         exit (1);
     }
@@ -78,12 +81,43 @@ void read_and_compare (int fd, char *read_buf, char *mmap_buf,
 }
 
 #define SIZE 1024 * 64
+#define PAGE 4096
+
+/* gives the device a hint and checks it returned want, 0 or an -errno */
+void check_fadvise (int fd, long long offset, long long len, int advice,
+                    int want)
+{
+    struct asgn1_fadvise fa;
+    int result;
+
+    fa.offset = offset;
+    fa.len = len;
+    fa.advice = advice;
+    result = ioctl (fd, TEM_FADVISE, &fa) < 0 ? -errno : 0;
+    if (result != want) {
+        fprintf (stderr, "fadvise %d of %lld bytes at %lld returned %d, "
+                 "not %d\n", advice, len, offset, result, want);
+        exit (1);
+    }
+}
+
+/* checks the device still holds size bytes matching expected */
+void check_device (int fd, char *read_buf, char *expected, off_t size)
+{
+    if (lseek (fd, 0, SEEK_END) != size) {
+        fprintf (stderr, "device size changed\n");
+        exit (1);
+    }
+    (void)lseek (fd, 0, SEEK_SET);
+    read_and_compare (fd, read_buf, expected, SIZE);
+}
 
 int main (int argc, char **argv)
 {
     unsigned long i, j;
-    int fd;
-    char *buf, *read_buf, *mmap_buf, *filename = "ramdisk";
+    off_t size;
+    int fd, ro_fd;
+    char *buf, *read_buf, *mmap_buf, *ro_buf, *filename = "ramdisk";
     int nproc = 12345;
 
     srandom (getpid ());
@@ -97,7 +131,10 @@ int main (int argc, char **argv)
         exit (1);
     }
 
-    assert(buf = malloc(SIZE));
+    if ((buf = malloc (SIZE)) == NULL || (read_buf = malloc (SIZE)) == NULL) {
+        fprintf (stderr, "malloc failed\n");
+        exit (1);
+    }
 
     for (i = 0; i < SIZE; i++) {
         buf[i] = random() % 256;
@@ -117,8 +154,6 @@ int main (int argc, char **argv)
     printf ("driver's ioctl says buffer size is %ld\n", len);
 #endif
 
-    assert(read_buf = malloc(SIZE));
-
     mmap_buf = mmap (NULL, SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
     if (mmap_buf == (char *)MAP_FAILED) {
         fprintf (stderr, "mmap of %s failed:  %s\n", filename,
@@ -144,6 +179,38 @@ int main (int argc, char **argv)
     printf ("comparison of modified data via read() and mmap() successful\n");
 
 
+    /* Opening write-only must not empty the device under the mapping */
+
+    if ((ro_fd = open (filename, O_WRONLY)) >= 0 || errno != EBUSY) {
+        fprintf (stderr, "write-only open of a mapped device gave %d:  %s\n",
+                 ro_fd, strerror (errno));
+        exit (1);
+    }
+    (void)lseek (fd, 0, SEEK_SET);
+    read_and_compare (fd, read_buf, mmap_buf, SIZE);
+    printf ("write-only open refused while mapped\n");
+
+
+    /* Map it again with each access pattern hint and compare through faults */
+
+    for (i = 0; i < 2; i++) {
+        munmap (mmap_buf, SIZE);
+        mmap_buf = mmap (NULL, SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mmap_buf == (char *)MAP_FAILED) {
+            fprintf (stderr, "mmap of %s failed:  %s\n", filename,
+                     strerror (errno));
+            exit (1);
+        }
+        if (madvise (mmap_buf, SIZE, i ? MADV_SEQUENTIAL : MADV_RANDOM) < 0) {
+            fprintf (stderr, "madvise failed:  %s\n", strerror (errno));
+            exit (1);
+        }
+        (void)lseek (fd, 0, SEEK_SET);
+        read_and_compare (fd, read_buf, mmap_buf, SIZE);
+    }
+    printf ("comparison after MADV_RANDOM and MADV_SEQUENTIAL successful\n");
+
+
     (void)lseek (fd, 0, SEEK_SET);
 
     if (ioctl (fd, ASGN1_SET_NPROC, &nproc) < 0) {
@@ -151,5 +218,68 @@ int main (int argc, char **argv)
         exit (1);
     }
     printf("nproc set to %d\n", nproc);
+
+
+    /* A read-only shared mapping through a read-only open must work too */
+
+    if ((ro_fd = open (filename, O_RDONLY)) < 0) {
+        fprintf (stderr, "read-only open of %s failed:  %s\n", filename,
+                 strerror (errno));
+        exit (1);
+    }
+    ro_buf = mmap (NULL, SIZE, PROT_READ, MAP_SHARED, ro_fd, 0);
+    if (ro_buf == (char *)MAP_FAILED) {
+        fprintf (stderr, "read-only mmap of %s failed:  %s\n", filename,
+                 strerror (errno));
+        exit (1);
+    }
+    read_and_compare (ro_fd, read_buf, ro_buf, SIZE);
+    munmap (ro_buf, SIZE);
+    close (ro_fd);
+    printf ("comparison through a read-only mapping successful\n");
+
+
+    /* Hints must never change the data, so unmap to let DONTNEED free */
+
+    munmap (mmap_buf, SIZE);
+    size = lseek (fd, 0, SEEK_END);
+    (void)lseek (fd, 0, SEEK_SET);
+    if (my_fread (fd, buf, SIZE) != SIZE) {
+        fprintf (stderr, "read problem:  %s\n", strerror (errno));
+        exit (1);
+    }
+
+    check_fadvise (fd, 0, 0, POSIX_FADV_WILLNEED, 0);
+    check_fadvise (fd, SIZE / 2 + 1, 3 * PAGE, POSIX_FADV_WILLNEED, 0);
+    check_device (fd, read_buf, buf, size);
+    printf ("WILLNEED successful\n");
+
+    // a page of zeroes that DONTNEED may turn into a hole, next to data
+    memset (buf + 2 * PAGE, 0, PAGE);
+    (void)lseek (fd, 2 * PAGE, SEEK_SET);
+    my_fwrite (fd, buf + 2 * PAGE, PAGE);
+    check_fadvise (fd, PAGE + 1, 3 * PAGE, POSIX_FADV_DONTNEED, 0);
+    check_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED, 0);
+    check_device (fd, read_buf, buf, size);
+    printf ("DONTNEED successful\n");
+
+    // past the end there is nothing to do, and the device must not grow
+    check_fadvise (fd, size, PAGE, POSIX_FADV_WILLNEED, 0);
+    check_fadvise (fd, size + 16 * PAGE, 0, POSIX_FADV_WILLNEED, 0);
+    check_fadvise (fd, size - 1, 16 * PAGE, POSIX_FADV_WILLNEED, 0);
+    check_fadvise (fd, size * 4, PAGE, POSIX_FADV_DONTNEED, 0);
+    check_device (fd, read_buf, buf, size);
+    printf ("hints past the end successful\n");
+
+    // ranges that wrap or go negative are refused
+    check_fadvise (fd, LLONG_MAX - PAGE, 2 * PAGE, POSIX_FADV_WILLNEED,
+                   -EINVAL);
+    check_fadvise (fd, PAGE, LLONG_MAX, POSIX_FADV_DONTNEED, -EINVAL);
+    check_fadvise (fd, LLONG_MAX, LLONG_MAX, POSIX_FADV_WILLNEED, -EINVAL);
+    check_fadvise (fd, -PAGE, PAGE, POSIX_FADV_WILLNEED, -EINVAL);
+    check_fadvise (fd, 0, -1, POSIX_FADV_DONTNEED, -EINVAL);
+    check_fadvise (fd, 0, 0, 12345, -EINVAL);
+    check_device (fd, read_buf, buf, size);
+    printf ("bad fadvise ranges refused\n");
     return 0;
 }
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+#include "asgn1_ring.h"
+
+/* load the module with asgn1_mode=2 before running this test */
+#define RECORDS 1000000
+#define MAX_RECORD 1000
+
+/* record i is RECORD_LEN(i) bytes, each one (seq + offset) */
+#define RECORD_LEN(i) (4 + (i) * 37 % (MAX_RECORD - 4))
+
+void fill_record (unsigned char *rec, unsigned int seq)
+{
+    unsigned int i;
+
+    memcpy (rec, &seq, 4);
+    for (i = 4; i < RECORD_LEN(seq); i++) {
+        rec[i] = seq + i;
+    }
+}
+
+void producer (struct asgn1_ring *ring)
+{
+    static unsigned char rec[MAX_RECORD];
+    unsigned int seq;
+    int result;
+
+    for (seq = 0; seq < RECORDS; seq++) {
+        fill_record (rec, seq);
+        while ((result = asgn1_ring_enqueue (ring, rec, RECORD_LEN(seq)))
+               == -EAGAIN) {
+            if (asgn1_ring_wait_space (ring, RECORD_LEN(seq)) < 0 &&
+                errno != EINTR) {
+                perror ("ASGN1_RING_WAIT_SPACE");
+                exit (1);
+            }
+        }
+        if (result < 0) {
+            fprintf (stderr, "enqueue failed:  %s\n", strerror (-result));
+            exit (1);
+        }
+    }
+    exit (0);
+}
+
+int main (int argc, char **argv)
+{
+    static unsigned char rec[MAX_RECORD], expected[MAX_RECORD];
+    unsigned int seq;
+    unsigned long sleeps = 0;
+    struct asgn1_ring ring;
+    struct pollfd pfd;
+    char *filename = "/dev/asgn1";
+    int fd, len, status;
+    pid_t pid;
+
+    if (argc > 1)
+        filename = argv[1];
+
+    if ((fd = open (filename, O_RDWR)) < 0) {
+        fprintf (stderr, "open of %s failed:  %s\n", filename,
+                 strerror (errno));
+        exit (1);
+    }
+
+    if (asgn1_ring_map (&ring, fd) < 0) {
+        fprintf (stderr, "mapping the ring failed:  %s\n", strerror (errno));
+        exit (1);
+    }
+    printf ("ring of %llu bytes mapped at %p\n",
+            (unsigned long long)ring.size, (void *)ring.data);
+    fflush (stdout);
+
+    if ((pid = fork ()) == 0)
+        producer (&ring);
+    assert(pid > 0);
+
+    for (seq = 0; seq < RECORDS; seq++) {
+        while ((len = asgn1_ring_dequeue (&ring, rec, sizeof(rec)))
+               == -EAGAIN) {
+            sleeps++;
+            if (sleeps % 2) {
+                /* every other sleep goes through poll() instead */
+                pfd.fd = fd;
+                pfd.events = POLLIN;
+                if (!asgn1_ring_prepare_data (&ring) &&
+                    poll (&pfd, 1, -1) < 0 && errno != EINTR) {
+                    perror ("poll()");
+                    exit (1);
+                }
+                asgn1_ring_finish_data (&ring);
+            } else if (asgn1_ring_wait_data (&ring) < 0 && errno != EINTR) {
+                perror ("ASGN1_RING_WAIT_DATA");
+                exit (1);
+            }
+        }
+
+        fill_record (expected, seq);
+        if (len != (int)RECORD_LEN(seq) || memcmp (rec, expected, len) != 0) {
+            fprintf (stderr, "record %u miscompare\n", seq);
+            exit (1);
+        }
+    }
+
+    waitpid (pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf (stderr, "producer failed\n");
+        exit (1);
+    }
+    printf ("%d records passed through the ring, consumer slept %lu times\n",
+            RECORDS, sleeps);
+    asgn1_ring_unmap (&ring);
+    return 0;
+}
@@ -0,0 +1,230 @@
+/**
+ * File: store_bench.c
+ *
+ * Microbenchmarks of the page store built in userspace: page lookups from
+ * the ends of the list, from a cursor and through the index of a fixed size
+ * store, and the read and write copy loops across store and block sizes.
+ * Needs no root or insmod, so the hot paths can be run under perf and
+ * compared from run to run. The results are written as JSON. -N uses the
+ * shim's SSE2 streaming stores and cache line flushes, as the module does.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include "asgn1_store.h"
+#include "bench_common.h"
+
+#define LOOKUP_OPS 16384
+
+/* options */
+static unsigned long store_sizes[MAX_SIZES];
+static int nr_store_sizes;
+static unsigned long block_sizes[MAX_SIZES];
+static int nr_block_sizes;
+static int nocache;
+static unsigned long max_ops = 1 << 16;   /* per copy test */
+static FILE *out;
+
+static int first_result = 1;
+static unsigned long seed = 1;
+
+static unsigned long rnd (void)
+{
+    seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+    return seed >> 33;
+}
+
+/**
+ * Writes one result object.
+ */
+static void report (const char *test, unsigned long store_size,
+                    unsigned long block_size, unsigned long bytes,
+                    unsigned long ops, uint64_t ns)
+{
+    double seconds = ns / 1e9;
+
+    fprintf (out, "%s\n    {\"test\": \"%s\", \"store_size\": %lu, "
+             "\"block_size\": %lu, \"nocache\": %d, \"bytes\": %lu, "
+             "\"ops\": %lu, \"seconds\": %.6f, \"mb_per_s\": %.2f, "
+             "\"ns_per_op\": %.1f}",
+             first_result ? "" : ",", test, store_size, block_size, nocache,
+             bytes, ops, seconds,
+             seconds > 0 ? bytes / seconds / (1 << 20) : 0.0,
+             ops ? (double)ns / ops : 0.0);
+    first_result = 0;
+}
+
+/**
+ * Sets up a store of size bytes, either grown by writing it full like the
+ * character device or fixed in size like the block device.
+ */
+static void setup_store (asgn1_store *store, unsigned long size, int fixed)
+{
+    static char buf[1 << 16];
+    asgn1_cursor cursor = { NULL, 0, 0 };
+    unsigned long pos;
+    ssize_t n;
+
+    if (init_store (store) < 0)
+        die ("init_store");
+    if (fixed) {
+        if (fix_store_size (store, size / PAGE_SIZE) < 0)
+            die ("fix_store_size");
+        return;
+    }
+
+    memset (buf, 'a', sizeof (buf));
+    for (pos = 0; pos < size; pos += n) {
+        n = store_write (store, &cursor, buf, size - pos < sizeof (buf) ?
+                         size - pos : sizeof (buf), pos, 0);
+        if (n <= 0)
+            die ("store_write");
+    }
+}
+
+static void bench_lookup (unsigned long size)
+{
+    asgn1_store store;
+    asgn1_cursor cursor = { NULL, 0, 0 };
+    unsigned long pages = size / PAGE_SIZE;
+    unsigned long i, index;
+    uint64_t start;
+
+    setup_store (&store, size, 0);
+
+    // the worst case, walking from the nearest end of the list
+    start = now_ns ();
+    for (i = 0; i < LOOKUP_OPS; i++)
+        find_page_node (&store, rnd () % pages, NULL);
+    report ("lookup_random", size, 0, 0, LOOKUP_OPS, now_ns () - start);
+
+    // small random steps away from the last lookup, resumed from a cursor
+    index = 0;
+    start = now_ns ();
+    for (i = 0; i < LOOKUP_OPS; i++) {
+        index = (index + rnd () % 16) % pages;
+        cursor.node = find_page_node (&store, index, &cursor);
+        cursor.node_no = index;
+        cursor.generation = store.generation;
+    }
+    report ("lookup_cursor", size, 0, 0, LOOKUP_OPS, now_ns () - start);
+    destroy_store (&store);
+
+    setup_store (&store, size, 1);
+    start = now_ns ();
+    for (i = 0; i < LOOKUP_OPS; i++)
+        find_page_node (&store, rnd () % pages, NULL);
+    report ("lookup_fixed", size, 0, 0, LOOKUP_OPS, now_ns () - start);
+    destroy_store (&store);
+}
+
+static void bench_copy (unsigned long size, unsigned long bs)
+{
+    asgn1_store store;
+    asgn1_cursor cursor = { NULL, 0, 0 };
+    unsigned long blocks = size / bs;
+    unsigned long ops = blocks < max_ops ? blocks : max_ops;
+    unsigned long i;
+    uint64_t start;
+    char *buf;
+
+    if (blocks == 0)
+        return;
+    if ((buf = malloc (bs)) == NULL)
+        die ("malloc");
+    memset (buf, 'b', bs);
+
+    // writing an empty store grows it a page at a time
+    if (init_store (&store) < 0)
+        die ("init_store");
+    start = now_ns ();
+    for (i = 0; i < blocks; i++)
+        store_write (&store, &cursor, buf, bs, i * bs, nocache);
+    report ("seq_write", size, bs, blocks * bs, blocks, now_ns () - start);
+
+    start = now_ns ();
+    for (i = 0; i < blocks; i++)
+        store_read (&store, &cursor, buf, bs, i * bs, nocache);
+    report ("seq_read", size, bs, blocks * bs, blocks, now_ns () - start);
+
+    start = now_ns ();
+    for (i = 0; i < ops; i++)
+        store_write (&store, &cursor, buf, bs, rnd () % blocks * bs, nocache);
+    report ("rand_write", size, bs, ops * bs, ops, now_ns () - start);
+
+    start = now_ns ();
+    for (i = 0; i < ops; i++)
+        store_read (&store, &cursor, buf, bs, rnd () % blocks * bs, nocache);
+    report ("rand_read", size, bs, ops * bs, ops, now_ns () - start);
+
+    destroy_store (&store);
+    free (buf);
+}
+
+static void usage (char *prog)
+{
+    fprintf (stderr, "usage: %s [-s sizes] [-b block sizes] [-n ops] [-N] "
+             "[-o file]\n", prog);
+    exit (1);
+}
+
+int main (int argc, char **argv)
+{
+    char default_sizes[] = "1M,64M";
+    char default_blocks[] = "512,4K,64K";
+    int i, j, opt;
+
+    out = stdout;
+    while ((opt = getopt (argc, argv, "s:b:n:No:")) != -1) {
+        switch (opt) {
+            case 's':
+                nr_store_sizes = parse_size_list (optarg, store_sizes);
+                break;
+            case 'b':
+                nr_block_sizes = parse_size_list (optarg, block_sizes);
+                break;
+            case 'n':
+                max_ops = strtoul (optarg, NULL, 0);
+                break;
+            case 'N':
+                if (!SHIM_NOCACHE) {
+                    fprintf (stderr, "nocache copies need SSE2 in "
+                             "userspace\n");
+                    exit (1);
+                }
+                nocache = 1;
+                break;
+            case 'o':
+                if ((out = fopen (optarg, "w")) == NULL)
+                    die ("fopen");
+                break;
+            default:
+                usage (argv[0]);
+        }
+    }
+    if (nr_store_sizes == 0)
+        nr_store_sizes = parse_size_list (default_sizes, store_sizes);
+    if (nr_block_sizes == 0)
+        nr_block_sizes = parse_size_list (default_blocks, block_sizes);
+
+    fprintf (out, "{\"page_size\": %lu, \"nocache\": %d, \"results\": [",
+             PAGE_SIZE, nocache);
+    for (i = 0; i < nr_store_sizes; i++) {
+        if (store_sizes[i] < PAGE_SIZE) {
+            fprintf (stderr, "store size %lu is less than a page\n",
+                     store_sizes[i]);
+            exit (1);
+        }
+        bench_lookup (store_sizes[i]);
+        for (j = 0; j < nr_block_sizes; j++)
+            bench_copy (store_sizes[i], block_sizes[j]);
+    }
+    fprintf (out, "\n]}\n");
+    fclose (out);
+    return 0;
+}
@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "asgn1_store.h"
+
+/*
+ * Runs the page store in userspace against a plain buffer holding what the
+ * device should contain. Build with make store_test, adding e.g.
+ * STORE_CFLAGS="-O1 -g -fsanitize=address" or -fsanitize=thread.
+ */
+
+#define MAX_PAGES 64            /* the model never grows past this */
+#define MAX_SIZE (MAX_PAGES * PAGE_SIZE)
+#define OPS 200000
+#define NCURSORS 3              /* files reading and writing at once */
+
+#define STRESS_PAGES 256
+#define STRESS_THREADS 4
+#define STRESS_OPS 200000
+
+static char model[MAX_SIZE];
+static size_t model_size;
+static char buf[MAX_SIZE];
+
+static unsigned long seed = 1;
+
+/* deterministic so a failure can be replayed */
+static unsigned long rnd (unsigned long *state)
+{
+    *state = *state * 6364136223846793005UL + 1442695040888963407UL;
+    return *state >> 33;
+}
+
+/* walks from the head of the list the slow way */
+static page_node *nth_node (asgn1_store *store, unsigned long index)
+{
+    page_node *curr;
+
+    list_for_each_entry (curr, &store->mem_list, list) {
+        if (index-- == 0)
+            return curr;
+    }
+    return NULL;
+}
+
+static void check_store (asgn1_store *store)
+{
+    page_node *curr;
+    int n = 0;
+
+    assert (store->data_size == model_size);
+    list_for_each_entry (curr, &store->mem_list, list)
+        n++;
+    assert (n == store->num_pages);
+    assert ((size_t)store->num_pages * PAGE_SIZE >= store->data_size);
+}
+
+static void check_read (asgn1_store *store, asgn1_cursor *cursor,
+                        size_t pos, size_t len)
+{
+    ssize_t got = store_read (store, cursor, buf, len, pos, rnd (&seed) & 1);
+    size_t want = pos >= model_size ? 0 :
+        (len < model_size - pos ? len : model_size - pos);
+
+    assert (got == (ssize_t)want);
+    assert (memcmp (buf, model + pos, want) == 0);
+}
+
+/* random reads, writes, discards and frees through several cursors */
+void model_test (void)
+{
+    asgn1_store store;
+    asgn1_cursor cursors[NCURSORS];
+    unsigned long i, index;
+    size_t pos, len, j;
+    asgn1_cursor *cursor;
+    ssize_t got;
+
+    assert (init_store (&store) == 0);
+    memset (cursors, 0, sizeof (cursors));
+
+    for (i = 0; i < OPS; i++) {
+        cursor = &cursors[rnd (&seed) % NCURSORS];
+
+        switch (rnd (&seed) % 16) {
+        case 0 ... 5:
+            // write anywhere up to the end of the data, so it grows
+            pos = model_size ? rnd (&seed) % (model_size + 1) : 0;
+            len = rnd (&seed) % (3 * PAGE_SIZE + 1);
+            if (pos + len > MAX_SIZE)
+                len = MAX_SIZE - pos;
+            for (j = 0; j < len; j++)
+                buf[j] = (char)rnd (&seed);
+            got = store_write (&store, cursor, buf, len, pos,
+                               rnd (&seed) & 1);
+            assert (got == (ssize_t)len);
+            memcpy (model + pos, buf, len);
+            if (pos + len > model_size)
+                model_size = pos + len;
+            break;
+        case 6 ... 11:
+            pos = rnd (&seed) % (model_size + PAGE_SIZE);
+            check_read (&store, cursor, pos, rnd (&seed) % (3 * PAGE_SIZE));
+            break;
+        case 12:
+            // writing past the end of the data writes nothing
+            pos = model_size + 1 + rnd (&seed) % PAGE_SIZE;
+            assert (store_write (&store, cursor, buf, 1, pos, 0) == 0);
+            break;
+        case 13:
+            // a whole page of data turns into a hole of zeroes
+            if (model_size < PAGE_SIZE)
+                break;
+            index = rnd (&seed) % (model_size / PAGE_SIZE);
+            discard_node_page (&store, find_page_node (&store, index, NULL));
+            memset (model + index * PAGE_SIZE, 0, PAGE_SIZE);
+            break;
+        case 14:
+            // only frees pages that hold nothing, so never changes the data
+            if (store.num_pages == 0)
+                break;
+            index = rnd (&seed) % store.num_pages;
+            discard_zero_page (&store, find_page_node (&store, index, NULL));
+            break;
+        case 15:
+            if (rnd (&seed) % 8 == 0) {
+                free_memory_pages (&store);
+                model_size = 0;
+            } else if (model_size >= PAGE_SIZE) {
+                // as the fifo does with a page it has read
+                free_first_page (&store);
+                memmove (model, model + PAGE_SIZE, model_size - PAGE_SIZE);
+                model_size -= PAGE_SIZE;
+            }
+            break;
+        }
+        check_store (&store);
+
+        // a cursor must never lead a lookup astray
+        if (store.num_pages > 0) {
+            index = rnd (&seed) % store.num_pages;
+            assert (find_page_node (&store, index, cursor) ==
+                    nth_node (&store, index));
+        }
+    }
+
+    check_read (&store, &cursors[0], 0, model_size);
+    destroy_store (&store);
+    printf ("model test passed, %d ops\n", OPS);
+}
+
+/* a fixed size store starts as holes and cannot grow */
+void fixed_test (void)
+{
+    asgn1_store store;
+    asgn1_cursor cursor = { NULL, 0, 0 };
+    unsigned long i;
+
+    assert (init_store (&store) == 0);
+    assert (fix_store_size (&store, MAX_PAGES) == 0);
+    assert (store.data_size == MAX_SIZE);
+    assert (fix_store_size (&store, 1) == -EBUSY);
+    assert (store.num_pages == MAX_PAGES);
+
+    memset (model, 0, MAX_SIZE);
+    model_size = MAX_SIZE;
+    check_read (&store, &cursor, 0, MAX_SIZE);
+    for (i = 0; i < MAX_PAGES; i++)
+        assert (store.index[i]->page == NULL);
+
+    memset (buf, 'x', PAGE_SIZE);
+    assert (store_write (&store, &cursor, buf, 2, MAX_SIZE - 1, 0) == 1);
+    assert (store_write (&store, &cursor, buf, 1, MAX_SIZE, 0) == -ENOSPC);
+    assert (store.num_pages == MAX_PAGES);
+    assert (store.data_size == MAX_SIZE);
+
+    free_memory_pages (&store);
+    assert (store.index == NULL);
+    destroy_store (&store);
+    printf ("fixed size test passed\n");
+}
+
+static asgn1_store stress_store;
+static char stress_model[STRESS_PAGES * PAGE_SIZE];
+static int stress_done;
+
+/*
+ * Each thread owns the pages whose number modulo the thread count is its
+ * own, so it can check every read against its part of the model while the
+ * store is shared.
+ */
+static void *stress_thread (void *arg)
+{
+    unsigned long t = (unsigned long)arg;
+    unsigned long state = t + 1;
+    static __thread char page_buf[PAGE_SIZE];
+    asgn1_cursor cursor = { NULL, 0, 0 };
+    unsigned long i, index;
+    size_t pos, off, len, j;
+    char *want;
+    int zero;
+
+    for (i = 0; i < STRESS_OPS; i++) {
+        index = (rnd (&state) % (STRESS_PAGES / STRESS_THREADS))
+            * STRESS_THREADS + t;
+        pos = index * PAGE_SIZE;
+        want = stress_model + pos;
+
+        switch (rnd (&state) % 8) {
+        case 0 ... 3:
+            off = rnd (&state) % PAGE_SIZE;
+            len = 1 + rnd (&state) % (PAGE_SIZE - off);
+            // zeroes give the scavenger something to free
+            zero = rnd (&state) % 4 == 0;
+            for (j = 0; j < len; j++)
+                page_buf[j] = zero ? 0 : (char)rnd (&state);
+            assert (store_write (&stress_store, &cursor, page_buf, len,
+                                 pos + off, rnd (&state) & 1) == (ssize_t)len);
+            memcpy (want + off, page_buf, len);
+            break;
+        case 4 ... 6:
+            assert (store_read (&stress_store, &cursor, page_buf, PAGE_SIZE,
+                                pos, 0) == PAGE_SIZE);
+            assert (memcmp (page_buf, want, PAGE_SIZE) == 0);
+            break;
+        case 7:
+            discard_node_page (&stress_store, stress_store.index[index]);
+            memset (want, 0, PAGE_SIZE);
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* frees zero pages under the owners' feet and comes and goes as a mapping */
+static void *scavenger_thread (void *arg)
+{
+    unsigned long i, passes = 0;
+
+    (void)arg;
+    while (!__atomic_load_n (&stress_done, __ATOMIC_ACQUIRE)) {
+        for (i = 0; i < STRESS_PAGES; i++)
+            discard_zero_page (&stress_store, stress_store.index[i]);
+
+        spin_lock (&stress_store.page_lock);
+        stress_store.nr_mappings = ++passes % 2;
+        spin_unlock (&stress_store.page_lock);
+    }
+    return NULL;
+}
+
+void stress_test (void)
+{
+    pthread_t threads[STRESS_THREADS];
+    pthread_t scavenger;
+    asgn1_cursor cursor = { NULL, 0, 0 };
+    unsigned long t;
+    size_t pos;
+
+    assert (init_store (&stress_store) == 0);
+    assert (fix_store_size (&stress_store, STRESS_PAGES) == 0);
+
+    pthread_create (&scavenger, NULL, scavenger_thread, NULL);
+    for (t = 0; t < STRESS_THREADS; t++)
+        pthread_create (&threads[t], NULL, stress_thread, (void *)t);
+    for (t = 0; t < STRESS_THREADS; t++)
+        pthread_join (threads[t], NULL);
+    __atomic_store_n (&stress_done, 1, __ATOMIC_RELEASE);
+    pthread_join (scavenger, NULL);
+
+    // everything the threads left behind must still be there
+    for (pos = 0; pos < sizeof (stress_model); pos += MAX_SIZE) {
+        assert (store_read (&stress_store, &cursor, buf, MAX_SIZE, pos, 0) ==
+                (ssize_t)MAX_SIZE);
+        assert (memcmp (buf, stress_model + pos, MAX_SIZE) == 0);
+    }
+
+    destroy_store (&stress_store);
+    printf ("stress test passed, %d threads\n", STRESS_THREADS);
+}
+
+int main (int argc, char **argv)
+{
+    if (argc > 1)
+        seed = strtoul (argv[1], NULL, 0);
+
+    model_test ();
+    fixed_test ();
+    stress_test ();
+    return 0;
+}